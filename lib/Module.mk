@@ -33,7 +33,7 @@ LIBMAN5FILES := $(MODULE_DIR)/sensors.conf.5
 # changed in a backward incompatible way.  The interface is defined by
 # the public header files - in this case they are error.h and sensors.h.
 LIBMAINVER := 5
-LIBMINORVER := 0.0
+LIBMINORVER := 1.0
 LIBVER := $(LIBMAINVER).$(LIBMINORVER)
 
 # The static lib name, the shared lib name, and the internal ('so') name of
@@ -43,6 +43,13 @@ LIBSHLIBNAME := libsensors.so.$(LIBVER)
 LIBSTLIBNAME := libsensors.a
 LIBSHSONAME := libsensors.so.$(LIBMAINVER)
 
+LIBLDLIBS := -lpthread
+ifeq ($(USE_LIBURING),1)
+LIBCPPFLAGS += -DHAVE_LIBURING
+ARCPPFLAGS += -DHAVE_LIBURING
+LIBLDLIBS += -luring
+endif
+
 LIBTARGETS := $(MODULE_DIR)/$(LIBSHLIBNAME) \
               $(MODULE_DIR)/$(LIBSHSONAME) $(MODULE_DIR)/$(LIBSHBASENAME)
 ifeq ($(BUILD_STATIC_LIB),1)
@@ -51,7 +58,11 @@ endif
 
 LIBCSOURCES := $(MODULE_DIR)/data.c $(MODULE_DIR)/general.c \
                $(MODULE_DIR)/error.c $(MODULE_DIR)/access.c \
-               $(MODULE_DIR)/init.c $(MODULE_DIR)/sysfs.c
+               $(MODULE_DIR)/init.c $(MODULE_DIR)/sysfs.c \
+               $(MODULE_DIR)/expr.c $(MODULE_DIR)/cache.c \
+               $(MODULE_DIR)/hotplug.c $(MODULE_DIR)/arena.c \
+               $(MODULE_DIR)/context.c $(MODULE_DIR)/alarm.c \
+               $(MODULE_DIR)/sampler.c $(MODULE_DIR)/stream.c
 
 LIBOTHEROBJECTS := $(MODULE_DIR)/conf-parse.o $(MODULE_DIR)/conf-lex.o
 LIBSHOBJECTS := $(LIBCSOURCES:.c=.lo) $(LIBOTHEROBJECTS:.o=.lo)
@@ -61,9 +72,14 @@ LIBEXTRACLEAN := $(MODULE_DIR)/conf-parse.h $(MODULE_DIR)/conf-parse.c \
 
 LIBHEADERFILES := $(MODULE_DIR)/error.h $(MODULE_DIR)/sensors.h
 
+# Folded expressions must give exactly the same results as unfolded ones,
+# so the compiler must not fuse multiplications and additions in expr.c
+$(MODULE_DIR)/expr.lo: LIBCFLAGS += -ffp-contract=off
+$(MODULE_DIR)/expr.ao: ARCFLAGS += -ffp-contract=off
+
 # How to create the shared library
 $(MODULE_DIR)/$(LIBSHLIBNAME): $(LIBSHOBJECTS) $(LIB_DIR)/libsensors.map
-	$(CC) -shared $(LDFLAGS) -Wl,--version-script=$(LIB_DIR)/libsensors.map -Wl,-soname,$(LIBSHSONAME) -o $@ $(LIBSHOBJECTS) -lc -lm
+	$(CC) -shared $(LDFLAGS) -Wl,--version-script=$(LIB_DIR)/libsensors.map -Wl,-soname,$(LIBSHSONAME) -o $@ $(LIBSHOBJECTS) $(LIBLDLIBS) -lc -lm
 
 $(MODULE_DIR)/$(LIBSHSONAME): $(MODULE_DIR)/$(LIBSHLIBNAME)
 	$(RM) $@
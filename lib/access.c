@@ -22,23 +22,48 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 #include "access.h"
 #include "sensors.h"
 #include "data.h"
 #include "error.h"
 #include "sysfs.h"
+#include "expr.h"
+#include "arena.h"
 
 /* We watch the recursion depth for variables only, as an easy way to
    detect cycles. */
 #define DEPTH_MAX	8
 
+/* Raw values read during a single top-level evaluation. Each attribute is
+   read at most once, so that all the references to a subfeature within an
+   expression see the same sample. */
+typedef struct sensors_memo_entry {
+	int subfeat_nr;
+	int res;
+	double val;
+} sensors_memo_entry;
+
+typedef struct sensors_memo {
+	sensors_memo_entry *entries;
+	int entries_count;
+	int entries_max;
+} sensors_memo;
+
+#define SENSORS_MEMO_INIT	{ NULL, 0, 0 }
+
 static int sensors_eval_expr(const sensors_chip_features *chip_features,
-			     const sensors_expr *expr,
-			     double val, int depth, double *result);
+			     const sensors_bound_prog *bound,
+			     double val, int depth, sensors_memo *memo,
+			     double *result);
+static void sensors_bind_chip(sensors_chip_features *chip);
+
+/* Serializes the discovery of chip features */
+static pthread_mutex_t sensors_load_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Compare two chips name descriptions, to see whether they could match.
    Return 0 if it does not match, return 1 if it does match. */
-static int sensors_match_chip(const sensors_chip_name *chip1,
+int sensors_match_chip(const sensors_chip_name *chip1,
 		       const sensors_chip_name *chip2)
 {
 	if ((chip1->prefix != SENSORS_CHIP_NAME_PREFIX_ANY) &&
@@ -90,19 +115,96 @@ sensors_for_all_config_chips(const sensors_chip_name *name,
 	return NULL;
 }
 
+/* Chips are only enumerated at initialization time, so that programs which
+   only care about a few chips don't pay for all the others. Chips taken
+   from the discovery cache already have their features. */
+const sensors_chip_features *
+sensors_load_chip(sensors_chip_features *chip)
+{
+	int err = 0;
+
+	if (__atomic_load_n(&chip->loaded, __ATOMIC_ACQUIRE))
+		return chip;
+
+	pthread_mutex_lock(&sensors_load_lock);
+	if (!chip->loaded) {
+		/* On failure, try again the next time */
+		if (!chip->subfeature)
+			err = sensors_read_sysfs_chip_features(chip);
+		if (!err) {
+			sensors_bind_chip(chip);
+			__atomic_store_n(&chip->loaded, 1, __ATOMIC_RELEASE);
+		}
+	}
+	pthread_mutex_unlock(&sensors_load_lock);
+
+	return err ? NULL : chip;
+}
+
+/* Look up a chip in the intern chip list, without loading it. Returns
+   NULL if not found. */
+static sensors_chip_features *
+sensors_find_chip(const sensors_chip_name *name)
+{
+	sensors_chip_features *chip;
+	int i;
+
+	/* Exact names can be looked up in the hash index */
+	if (sensors_proc_chips_index &&
+	    name->prefix != SENSORS_CHIP_NAME_PREFIX_ANY &&
+	    name->bus.type != SENSORS_BUS_TYPE_ANY &&
+	    name->bus.nr != SENSORS_BUS_NR_ANY &&
+	    name->addr != SENSORS_CHIP_NAME_ADDR_ANY) {
+		unsigned int mask = sensors_proc_chips_index_size - 1;
+		unsigned int slot = sensors_hash_chip_name(name) & mask;
+
+		for (; (i = sensors_proc_chips_index[slot]) >= 0;
+		     slot = (slot + 1) & mask) {
+			chip = sensors_proc_chips[i];
+			if (chip->chip.addr == name->addr &&
+			    chip->chip.bus.nr == name->bus.nr &&
+			    chip->chip.bus.type == name->bus.type &&
+			    !strcmp(chip->chip.prefix, name->prefix))
+				return chip;
+		}
+		return NULL;
+	}
+
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		chip = sensors_proc_chips[i];
+		if (!chip->removed && sensors_match_chip(&chip->chip, name))
+			return chip;
+	}
+
+	return NULL;
+}
+
 /* Look up a chip in the intern chip list, and return a pointer to it.
    Do not modify the struct the return value points to! Returns NULL if
-   not found.*/
+   not found, with *err set to -SENSORS_ERR_NO_ENTRY, or if its features
+   can't be discovered, with *err set to -SENSORS_ERR_KERNEL. */
 static const sensors_chip_features *
-sensors_lookup_chip(const sensors_chip_name *name)
+sensors_lookup_chip_err(const sensors_chip_name *name, int *err)
 {
-	int i;
+	const sensors_chip_features *chip_features;
+	sensors_chip_features *chip;
 
-	for (i = 0; i < sensors_proc_chips_count; i++)
-		if (sensors_match_chip(&sensors_proc_chips[i].chip, name))
-			return &sensors_proc_chips[i];
+	if (!(chip = sensors_find_chip(name))) {
+		*err = -SENSORS_ERR_NO_ENTRY;
+		return NULL;
+	}
+	if (!(chip_features = sensors_load_chip(chip)))
+		*err = -SENSORS_ERR_KERNEL;
+	return chip_features;
+}
 
-	return NULL;
+/* Same as above, for callers which don't report errors */
+static const sensors_chip_features *
+sensors_lookup_chip(const sensors_chip_name *name)
+{
+	int err;
+
+	return sensors_lookup_chip_err(name, &err);
 }
 
 /* Look up a subfeature of the given chip, and return a pointer to it.
@@ -118,18 +220,6 @@ sensors_lookup_subfeature_nr(const sensors_chip_features *chip,
 	return chip->subfeature + subfeat_nr;
 }
 
-/* Look up a feature of the given chip, and return a pointer to it.
-   Do not modify the struct the return value points to! Returns NULL if
-   not found.*/
-static const sensors_feature *
-sensors_lookup_feature_nr(const sensors_chip_features *chip, int feat_nr)
-{
-	if (feat_nr < 0 ||
-	    feat_nr >= chip->feature_count)
-		return NULL;
-	return chip->feature + feat_nr;
-}
-
 /* Look up a subfeature by name, and return a pointer to it.
    Do not modify the struct the return value points to! Returns NULL if 
    not found.*/
@@ -159,12 +249,11 @@ int sensors_chip_name_has_wildcards(const sensors_chip_name *chip)
 		return 0;
 }
 
-/* Look up the label for a given feature. Note that chip should not
-   contain wildcard values! The returned string is newly allocated (free it
-   yourself). On failure, NULL is returned.
-   If no label exists for this feature, its name is returned itself. */
-char *sensors_get_label(const sensors_chip_name *name,
-			const sensors_feature *feature)
+/* Look up the label for a given feature, in the configuration file first,
+   then in sysfs. The returned string is newly allocated. If no label exists
+   for this feature, its name is returned itself. */
+static char *sensors_read_label(const sensors_chip_name *name,
+				const sensors_feature *feature)
 {
 	char *label;
 	const sensors_chip *chip;
@@ -172,14 +261,11 @@ char *sensors_get_label(const sensors_chip_name *name,
 	FILE *f;
 	int i;
 
-	if (sensors_chip_name_has_wildcards(name))
-		return NULL;
-
 	for (chip = NULL; (chip = sensors_for_all_config_chips(name, chip));)
 		for (i = 0; i < chip->labels_count; i++)
 			if (!strcmp(feature->name, chip->labels[i].name)) {
 				label = chip->labels[i].value;
-				goto sensors_get_label_exit;
+				goto sensors_read_label_exit;
 			}
 
 	/* No user specified label, check for a _label sysfs file */
@@ -192,20 +278,87 @@ char *sensors_get_label(const sensors_chip_name *name,
 			/* i - 1 to strip the '\n' at the end */
 			buf[i - 1] = 0;
 			label = buf;
-			goto sensors_get_label_exit;
+			goto sensors_read_label_exit;
 		}
 	}
 
 	/* No label, return the feature name instead */
 	label = feature->name;
 	
-sensors_get_label_exit:
+sensors_read_label_exit:
 	label = strdup(label);
 	if (!label)
 		sensors_fatal_error(__func__, "Allocating label text");
 	return label;
 }
 
+/* Returns 1 if feature is one of the current features of chip. Features
+   of the tables a chip had before its device came back aren't. */
+static int sensors_feature_of(const sensors_chip_features *chip,
+			      const sensors_feature *feature)
+{
+	return feature->number >= 0 &&
+	       feature->number < chip->feature_count &&
+	       feature == &chip->feature[feature->number];
+}
+
+/* Look up the label for a given feature. Note that chip should not
+   contain wildcard values! The label is looked up on first use, then
+   cached in the chip features, so the returned string must not be freed.
+   It remains valid until sensors_cleanup() is called. On failure, NULL is
+   returned. If no label exists for this feature, its name is returned
+   itself. */
+const char *sensors_get_label_const(const sensors_chip_name *name,
+				    const sensors_feature *feature)
+{
+	const sensors_chip_features *chip;
+	char *label, *copy;
+
+	if (sensors_chip_name_has_wildcards(name))
+		return NULL;
+	if (!(chip = sensors_lookup_chip(name)))
+		return NULL;
+
+	/* Features which don't come from us can't be cached */
+	if (!chip->label || !sensors_feature_of(chip, feature))
+		return NULL;
+
+	label = chip->label[feature->number];
+	if (label)
+		return label;
+
+	/* Interned, so that it remains valid if the chip gets other tables,
+	   see hotplug.c. Several threads may race to look the label up,
+	   only one wins. */
+	copy = sensors_read_label(&chip->chip, feature);
+	label = sensors_intern(copy);
+	free(copy);
+	__sync_bool_compare_and_swap(&chip->label[feature->number], NULL,
+				     label);
+	return chip->label[feature->number];
+}
+
+/* Same as above, but the returned string is newly allocated (free it
+   yourself). */
+char *sensors_get_label(const sensors_chip_name *name,
+			const sensors_feature *feature)
+{
+	const char *label;
+	char *res;
+
+	if (sensors_chip_name_has_wildcards(name))
+		return NULL;
+
+	label = sensors_get_label_const(name, feature);
+	if (!label)
+		return sensors_read_label(name, feature);
+
+	res = strdup(label);
+	if (!res)
+		sensors_fatal_error(__func__, "Allocating label text");
+	return res;
+}
+
 /* Looks up whether a feature should be ignored. Returns
    1 if it should be ignored, 0 if not. */
 static int sensors_get_ignored(const sensors_chip_name *name,
@@ -221,65 +374,269 @@ static int sensors_get_ignored(const sensors_chip_name *name,
 	return 0;
 }
 
+/* Look up the compute statement which applies to a feature, in the
+   configuration file. Returns NULL if there is none. */
+static const sensors_compute *
+sensors_find_compute(const sensors_chip_name *name,
+		     const sensors_feature *feature)
+{
+	const sensors_chip *chip;
+	int i;
+
+	for (chip = NULL; (chip = sensors_for_all_config_chips(name, chip));)
+		for (i = 0; i < chip->computes_count; i++)
+			if (!strcmp(feature->name, chip->computes[i].name))
+				return &chip->computes[i];
+	return NULL;
+}
+
+/* Resolve the variables of a program to subfeature numbers of a chip.
+   The caller must free bound->vars. */
+static void sensors_bind_prog(const sensors_chip_features *chip,
+			      const sensors_prog *prog,
+			      sensors_bound_prog *bound)
+{
+	const sensors_subfeature *subfeature;
+	int i;
+
+	bound->prog = prog;
+	bound->vars = NULL;
+	if (!prog->vars_count)
+		return;
+
+	bound->vars = malloc(prog->vars_count * sizeof(int));
+	if (!bound->vars)
+		sensors_fatal_error(__func__, "Out of memory");
+	for (i = 0; i < prog->vars_count; i++) {
+		subfeature = sensors_lookup_subfeature_name(chip,
+							    prog->vars[i]);
+		bound->vars[i] = subfeature ? subfeature->number : -1;
+	}
+}
+
+void sensors_unbind_config(sensors_chip_features *chip)
+{
+	int i;
+
+	free(chip->next_visible);
+	chip->next_visible = NULL;
+
+	if (!chip->compute)
+		return;
+	for (i = 0; i < chip->feature_count; i++) {
+		free(chip->compute[i].from_proc.vars);
+		free(chip->compute[i].to_proc.vars);
+	}
+	free(chip->compute);
+	chip->compute = NULL;
+}
+
+/* Bind the configuration file to the features of a chip, so that
+   enumerating features, and reading and writing values, don't have to
+   search the configuration, nor look variables up by name */
+static void sensors_bind_chip(sensors_chip_features *chip)
+{
+	const sensors_compute *compute;
+	int j, next;
+
+	sensors_unbind_config(chip);
+
+	/* Ignore statements */
+	chip->next_visible = malloc((chip->feature_count + 1) * sizeof(int));
+	if (!chip->next_visible)
+		sensors_fatal_error(__func__, "Out of memory");
+	next = chip->feature_count;
+	chip->next_visible[next] = next;
+	for (j = chip->feature_count - 1; j >= 0; j--) {
+		if (!sensors_get_ignored(&chip->chip, &chip->feature[j]))
+			next = j;
+		chip->next_visible[j] = next;
+	}
+
+	/* Compute statements */
+	chip->compute = calloc(chip->feature_count,
+			       sizeof(sensors_bound_compute));
+	if (chip->feature_count && !chip->compute)
+		sensors_fatal_error(__func__, "Out of memory");
+
+	for (j = 0; j < chip->feature_count; j++) {
+		compute = sensors_find_compute(&chip->chip, &chip->feature[j]);
+		if (!compute)
+			continue;
+		sensors_bind_prog(chip, compute->from_prog,
+				  &chip->compute[j].from_proc);
+		sensors_bind_prog(chip, compute->to_prog,
+				  &chip->compute[j].to_proc);
+	}
+}
+
+/* Bind the configuration file to the features of the detected chips. Must
+   be called again whenever either the configuration or the list of
+   detected chips changes. Chips which weren't used yet get bound when
+   their features are discovered. */
+void sensors_bind_config(void)
+{
+	int i;
+
+	for (i = 0; i < sensors_proc_chips_count; i++)
+		if (sensors_proc_chips[i]->loaded)
+			sensors_bind_chip(sensors_proc_chips[i]);
+}
+
+/* Returns 1 if a feature is ignored, 0 if not */
+static int sensors_feature_ignored(const sensors_chip_features *chip,
+				   int feat_nr)
+{
+	if (chip->next_visible)
+		return chip->next_visible[feat_nr] != feat_nr;
+	return sensors_get_ignored(&chip->chip, &chip->feature[feat_nr]);
+}
+
+/* Return the compute statement program which applies to a subfeature:
+   the from_proc program, or the to_proc program if write is set.
+   Returns NULL if there is no compute statement for this subfeature. */
+static const sensors_bound_prog *
+sensors_lookup_compute(const sensors_chip_features *chip_features,
+		       const sensors_subfeature *subfeature, int write)
+{
+	const sensors_bound_compute *compute;
+
+	if (!(subfeature->flags & SENSORS_COMPUTE_MAPPING) ||
+	    !chip_features->compute)
+		return NULL;
+	compute = &chip_features->compute[subfeature->mapping];
+	if (!compute->from_proc.prog)
+		return NULL;
+	return write ? &compute->to_proc : &compute->from_proc;
+}
+
+static void sensors_memo_free(sensors_memo *memo)
+{
+	free(memo->entries);
+}
+
+static void sensors_memo_add(sensors_memo *memo, int subfeat_nr, int res,
+			     double val)
+{
+	sensors_memo_entry entry;
+
+	entry.subfeat_nr = subfeat_nr;
+	entry.res = res;
+	entry.val = val;
+	sensors_add_array_el(&entry, &memo->entries, &memo->entries_count,
+			     &memo->entries_max, sizeof(sensors_memo_entry));
+}
+
+/* Forget a subfeature, after a new value has been written to it */
+static void sensors_memo_forget(sensors_memo *memo, int subfeat_nr)
+{
+	int i;
+
+	for (i = 0; i < memo->entries_count; i++)
+		if (memo->entries[i].subfeat_nr == subfeat_nr)
+			memo->entries[i].subfeat_nr = -1;
+}
+
+/* Read the raw value of a subfeature, unless it was already read */
+static int sensors_read_memo(const sensors_chip_features *chip_features,
+			     const sensors_subfeature *subfeature,
+			     sensors_memo *memo, double *val)
+{
+	int i, res;
+
+	if (!memo)
+		return sensors_read_sysfs_attr(chip_features, subfeature, val);
+
+	for (i = 0; i < memo->entries_count; i++)
+		if (memo->entries[i].subfeat_nr == subfeature->number) {
+			*val = memo->entries[i].val;
+			return memo->entries[i].res;
+		}
+
+	res = sensors_read_sysfs_attr(chip_features, subfeature, val);
+	/* *val is left alone on error */
+	sensors_memo_add(memo, subfeature->number, res, res ? 0.0 : *val);
+	return res;
+}
+
+/* Read the value of a subfeature, and apply its compute statement if any */
+static int sensors_eval_value(const sensors_chip_features *chip_features,
+			      const sensors_subfeature *subfeature,
+			      int depth, sensors_memo *memo, double *result)
+{
+	const sensors_bound_prog *bound;
+	double val;
+	int res;
+
+	/* Apply compute statement if it exists */
+	bound = sensors_lookup_compute(chip_features, subfeature, 0);
+
+	if (!bound)
+		return sensors_read_memo(chip_features, subfeature, memo,
+					 result);
+
+	res = sensors_read_memo(chip_features, subfeature, memo, &val);
+	if (res)
+		return res;
+	return sensors_eval_expr(chip_features, bound, val, depth, memo,
+				 result);
+}
+
 /* Read the value of a subfeature of a certain chip. Note that chip should not
    contain wildcard values! This function will return 0 on success, and <0
    on failure. */
-static int __sensors_get_value(const sensors_chip_name *name, int subfeat_nr,
-			       int depth, double *result)
+int sensors_get_value(const sensors_chip_name *name, int subfeat_nr,
+		      double *result)
 {
 	const sensors_chip_features *chip_features;
 	const sensors_subfeature *subfeature;
-	const sensors_expr *expr = NULL;
-	double val;
-	int res, i;
+	const sensors_bound_prog *bound;
+	sensors_memo memo = SENSORS_MEMO_INIT;
+	int res;
 
-	if (depth >= DEPTH_MAX)
-		return -SENSORS_ERR_RECURSION;
 	if (sensors_chip_name_has_wildcards(name))
 		return -SENSORS_ERR_WILDCARDS;
-	if (!(chip_features = sensors_lookup_chip(name)))
-		return -SENSORS_ERR_NO_ENTRY;
+	if (!(chip_features = sensors_lookup_chip_err(name, &res)))
+		return res;
 	if (!(subfeature = sensors_lookup_subfeature_nr(chip_features,
 							subfeat_nr)))
 		return -SENSORS_ERR_NO_ENTRY;
 	if (!(subfeature->flags & SENSORS_MODE_R))
 		return -SENSORS_ERR_ACCESS_R;
 
-	/* Apply compute statement if it exists */
-	if (subfeature->flags & SENSORS_COMPUTE_MAPPING) {
-		const sensors_feature *feature;
-		const sensors_chip *chip;
-
-		feature = sensors_lookup_feature_nr(chip_features,
-					subfeature->mapping);
-
-		chip = NULL;
-		while (!expr &&
-		       (chip = sensors_for_all_config_chips(name, chip)))
-			for (i = 0; i < chip->computes_count; i++) {
-				if (!strcmp(feature->name,
-					    chip->computes[i].name)) {
-					expr = chip->computes[i].from_proc;
-					break;
-				}
-			}
-	}
+	/* Plain attributes don't need the memo */
+	bound = sensors_lookup_compute(chip_features, subfeature, 0);
+	if (!bound || !bound->vars)
+		return sensors_eval_value(chip_features, subfeature, 0, NULL,
+					  result);
 
-	res = sensors_read_sysfs_attr(name, subfeature, &val);
-	if (res)
-		return res;
-	if (!expr)
-		*result = val;
-	else if ((res = sensors_eval_expr(chip_features, expr, val, depth,
-					  result)))
-		return res;
-	return 0;
+	res = sensors_eval_value(chip_features, subfeature, 0, &memo, result);
+	sensors_memo_free(&memo);
+	return res;
 }
 
-int sensors_get_value(const sensors_chip_name *name, int subfeat_nr,
-		      double *result)
+/* Write the value of a subfeature, applying its compute statement if any */
+static int sensors_set_memo(const sensors_chip_features *chip_features,
+			    const sensors_subfeature *subfeature,
+			    double value, sensors_memo *memo)
 {
-	return __sensors_get_value(name, subfeat_nr, 0, result);
+	const sensors_bound_prog *bound;
+	double to_write;
+	int res;
+
+	/* Apply compute statement if it exists */
+	bound = sensors_lookup_compute(chip_features, subfeature, 1);
+
+	to_write = value;
+	if (bound)
+		if ((res = sensors_eval_expr(chip_features, bound,
+					     value, 0, memo, &to_write)))
+			return res;
+
+	res = sensors_write_sysfs_attr(&chip_features->chip, subfeature,
+				       to_write);
+	sensors_memo_forget(memo, subfeature->number);
+	return res;
 }
 
 /* Set the value of a subfeature of a certain chip. Note that chip should not
@@ -290,57 +647,219 @@ int sensors_set_value(const sensors_chip_name *name, int subfeat_nr,
 {
 	const sensors_chip_features *chip_features;
 	const sensors_subfeature *subfeature;
-	const sensors_expr *expr = NULL;
-	int i, res;
-	double to_write;
+	sensors_memo memo = SENSORS_MEMO_INIT;
+	int res;
 
 	if (sensors_chip_name_has_wildcards(name))
 		return -SENSORS_ERR_WILDCARDS;
-	if (!(chip_features = sensors_lookup_chip(name)))
-		return -SENSORS_ERR_NO_ENTRY;
+	if (!(chip_features = sensors_lookup_chip_err(name, &res)))
+		return res;
 	if (!(subfeature = sensors_lookup_subfeature_nr(chip_features,
 							subfeat_nr)))
 		return -SENSORS_ERR_NO_ENTRY;
 	if (!(subfeature->flags & SENSORS_MODE_W))
 		return -SENSORS_ERR_ACCESS_W;
 
-	/* Apply compute statement if it exists */
-	if (subfeature->flags & SENSORS_COMPUTE_MAPPING) {
-		const sensors_feature *feature;
-		const sensors_chip *chip;
-
-		feature = sensors_lookup_feature_nr(chip_features,
-					subfeature->mapping);
-
-		chip = NULL;
-		while (!expr &&
-		       (chip = sensors_for_all_config_chips(name, chip)))
-			for (i = 0; i < chip->computes_count; i++) {
-				if (!strcmp(feature->name,
-					    chip->computes[i].name)) {
-					expr = chip->computes[i].to_proc;
-					break;
-				}
-			}
-	}
+	res = sensors_set_memo(chip_features, subfeature, value, &memo);
+	sensors_memo_free(&memo);
+	return res;
+}
 
-	to_write = value;
-	if (expr)
-		if ((res = sensors_eval_expr(chip_features, expr,
-					     value, 0, &to_write)))
+/* In a read set, everything sensors_get_value() would look up is resolved
+   once and for all. The attributes are read as a single batch. */
+struct sensors_read_set {
+	sensors_read_set_entry *entries;
+	sensors_sysfs_attr *attrs;
+	const sensors_bound_prog **progs;
+	int *errors;
+	sensors_sysfs_batch *batch;
+	int count;
+};
+
+static sensors_read_set *sensors_read_set_alloc(int count)
+{
+	sensors_read_set *set;
+
+	set = calloc(1, sizeof(sensors_read_set));
+	if (!set)
+		sensors_fatal_error(__func__, "Allocating read set");
+	set->entries = malloc(count * sizeof(sensors_read_set_entry));
+	set->attrs = malloc(count * sizeof(sensors_sysfs_attr));
+	set->progs = malloc(count * sizeof(sensors_bound_prog *));
+	set->errors = malloc(count * sizeof(int));
+	if (count && (!set->entries || !set->attrs || !set->progs ||
+		      !set->errors))
+		sensors_fatal_error(__func__, "Allocating read set");
+	set->count = count;
+
+	return set;
+}
+
+/* Resolve entry nr of a read set. Returns 0 on success, <0 on error. */
+static int sensors_read_set_resolve(sensors_read_set *set, int nr)
+{
+	const sensors_read_set_entry *entry = &set->entries[nr];
+	sensors_sysfs_attr *attr = &set->attrs[nr];
+	int err;
+
+	if (sensors_chip_name_has_wildcards(entry->name))
+		return -SENSORS_ERR_WILDCARDS;
+	if (!(attr->chip = sensors_lookup_chip_err(entry->name, &err)))
+		return err;
+	if (!(attr->subfeature = sensors_lookup_subfeature_nr(attr->chip,
+							entry->subfeat_nr)))
+		return -SENSORS_ERR_NO_ENTRY;
+	if (!(attr->subfeature->flags & SENSORS_MODE_R))
+		return -SENSORS_ERR_ACCESS_R;
+
+	set->progs[nr] = sensors_lookup_compute(attr->chip, attr->subfeature,
+						0);
+
+	return 0;
+}
+
+int sensors_read_set_create(sensors_read_set **set,
+			    const sensors_read_set_entry *entries, int count)
+{
+	sensors_read_set *new_set;
+	int i, res;
+
+	if (count < 0)
+		return -SENSORS_ERR_NO_ENTRY;
+
+	new_set = sensors_read_set_alloc(count);
+	for (i = 0; i < count; i++) {
+		new_set->entries[i] = entries[i];
+		if ((res = sensors_read_set_resolve(new_set, i))) {
+			sensors_read_set_free(new_set);
 			return res;
-	return sensors_write_sysfs_attr(name, subfeature, to_write);
+		}
+	}
+	new_set->batch = sensors_sysfs_batch_new(new_set->attrs, count);
+
+	*set = new_set;
+	return 0;
+}
+
+/* Add all readable subfeatures of a feature to a read set being built */
+static void sensors_read_set_add_feature(sensors_read_set *set,
+					 const sensors_chip_features *chip,
+					 const sensors_feature *feature)
+{
+	const sensors_subfeature *subfeature;
+	int i;
+
+	for (i = feature->first_subfeature; i < chip->subfeature_count &&
+	     chip->subfeature[i].mapping == feature->number; i++) {
+		subfeature = &chip->subfeature[i];
+		if (!(subfeature->flags & SENSORS_MODE_R))
+			continue;
+
+		/* Several chips may have the same name, so don't look the
+		   chip up by name */
+		set->entries[set->count].name = &chip->chip;
+		set->entries[set->count].subfeat_nr = subfeature->number;
+		set->attrs[set->count].chip = chip;
+		set->attrs[set->count].subfeature = subfeature;
+		set->progs[set->count] = sensors_lookup_compute(chip,
+								subfeature, 0);
+		set->count++;
+	}
+}
+
+int sensors_read_set_create_all(sensors_read_set **set)
+{
+	const sensors_chip_features *chip;
+	sensors_read_set *new_set;
+	int i, j, count = 0;
+
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		if (sensors_proc_chips[i]->removed)
+			continue;
+		chip = sensors_load_chip(sensors_proc_chips[i]);
+		if (!chip)
+			return -SENSORS_ERR_KERNEL;
+		count += chip->subfeature_count;
+	}
+
+	new_set = sensors_read_set_alloc(count);
+	new_set->count = 0;
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		chip = sensors_proc_chips[i];
+		if (chip->removed)
+			continue;
+		for (j = 0; j < chip->feature_count; j++)
+			if (!sensors_feature_ignored(chip, j))
+				sensors_read_set_add_feature(new_set, chip,
+							&chip->feature[j]);
+	}
+	new_set->batch = sensors_sysfs_batch_new(new_set->attrs,
+						 new_set->count);
+
+	*set = new_set;
+	return 0;
+}
+
+const sensors_read_set_entry *
+sensors_read_set_get_entries(const sensors_read_set *set, int *count)
+{
+	*count = set->count;
+	return set->entries;
+}
+
+int sensors_read_set_sample(sensors_read_set *set, double *values,
+			    int *errors)
+{
+	int i, res = 0;
+
+	if (!errors)
+		errors = set->errors;
+
+	sensors_read_sysfs_batch(set->batch, values, errors);
+
+	for (i = 0; i < set->count; i++) {
+		if (!errors[i] && set->progs[i]) {
+			sensors_memo memo = SENSORS_MEMO_INIT;
+
+			/* Variables see the same raw value as the batch */
+			if (set->progs[i]->vars)
+				sensors_memo_add(&memo,
+						 set->attrs[i].subfeature->number,
+						 0, values[i]);
+			errors[i] = sensors_eval_expr(set->attrs[i].chip,
+						      set->progs[i], values[i],
+						      0, &memo, &values[i]);
+			sensors_memo_free(&memo);
+		}
+		if (errors[i])
+			res = errors[i];
+	}
+	return res;
+}
+
+void sensors_read_set_free(sensors_read_set *set)
+{
+	if (!set)
+		return;
+	sensors_sysfs_batch_free(set->batch);
+	free(set->entries);
+	free(set->attrs);
+	free(set->progs);
+	free(set->errors);
+	free(set);
 }
 
 const sensors_chip_name *sensors_get_detected_chips(const sensors_chip_name
 						    *match, int *nr)
 {
-	const sensors_chip_name *res;
+	const sensors_chip_features *chip;
 
 	while (*nr < sensors_proc_chips_count) {
-		res = &sensors_proc_chips[(*nr)++].chip;
-		if (!match || sensors_match_chip(res, match))
-			return res;
+		chip = sensors_proc_chips[(*nr)++];
+		if (chip->removed)
+			continue;
+		if (!match || sensors_match_chip(&chip->chip, match))
+			return &chip->chip;
 	}
 	return NULL;
 }
@@ -389,9 +908,16 @@ sensors_get_features(const sensors_chip_name *name, int *nr)
 	if (!(chip = sensors_lookup_chip(name)))
 		return NULL;	/* No such chip */
 
-	while (*nr < chip->feature_count
-	    && sensors_get_ignored(name, &chip->feature[*nr]))
-		(*nr)++;
+	if (*nr >= chip->feature_count)
+		return NULL;
+	if (chip->next_visible) {
+		/* Skip ignored features, they were resolved at init time */
+		*nr = chip->next_visible[*nr];
+	} else {
+		while (*nr < chip->feature_count
+		    && sensors_get_ignored(name, &chip->feature[*nr]))
+			(*nr)++;
+	}
 	if (*nr >= chip->feature_count)
 		return NULL;
 	return &chip->feature[(*nr)++];
@@ -406,6 +932,8 @@ sensors_get_all_subfeatures(const sensors_chip_name *name,
 
 	if (!(chip = sensors_lookup_chip(name)))
 		return NULL;	/* No such chip */
+	if (!sensors_feature_of(chip, feature))
+		return NULL;	/* Feature of the chip's previous device */
 
 	/* Seek directly to the first subfeature */
 	if (*nr < feature->first_subfeature)
@@ -425,10 +953,35 @@ sensors_get_subfeature(const sensors_chip_name *name,
 		       sensors_subfeature_type type)
 {
 	const sensors_chip_features *chip;
-	int i;
+	int i, slot;
 
 	if (!(chip = sensors_lookup_chip(name)))
 		return NULL;	/* No such chip */
+	if (!sensors_feature_of(chip, feature))
+		return NULL;	/* Feature of the chip's previous device */
+
+	if (chip->subfeature_slot) {
+		/* Same layout as the sparse table of
+		   sensors_read_dynamic_chip() */
+		if ((int)(type >> 8) != (int)feature->type)
+			return NULL;
+		if (feature->type < SENSORS_FEATURE_VID) {
+			slot = type & 0x7F;
+			if (slot >= chip->slot_count / 2)
+				return NULL;
+			slot += ((type & 0x80) >> 7) * (chip->slot_count / 2);
+		} else {
+			slot = type & 0xFF;
+			if (slot >= chip->slot_count)
+				return NULL;
+		}
+
+		i = chip->subfeature_slot[feature->number * chip->slot_count +
+					  slot];
+		if (!i)
+			return NULL;	/* No such subfeature */
+		return &chip->subfeature[feature->first_subfeature + i - 1];
+	}
 
 	for (i = feature->first_subfeature; i < chip->subfeature_count &&
 	     chip->subfeature[i].mapping == feature->number; i++) {
@@ -438,66 +991,47 @@ sensors_get_subfeature(const sensors_chip_name *name,
 	return NULL;	/* No such subfeature */
 }
 
+/* Variables of expressions are other subfeatures of the same chip */
+struct sensors_eval_data {
+	const sensors_chip_features *chip_features;
+	const int *vars;
+	int depth;
+	sensors_memo *memo;
+};
+
+static int sensors_eval_get_var(const void *data, int var, double *value)
+{
+	const struct sensors_eval_data *eval = data;
+	const sensors_subfeature *subfeature;
+	int depth = eval->depth + 1;
+
+	if (depth >= DEPTH_MAX)
+		return -SENSORS_ERR_RECURSION;
+	if (eval->vars[var] < 0)
+		return -SENSORS_ERR_NO_ENTRY;
+	subfeature = &eval->chip_features->subfeature[eval->vars[var]];
+	if (!(subfeature->flags & SENSORS_MODE_R))
+		return -SENSORS_ERR_ACCESS_R;
+
+	return sensors_eval_value(eval->chip_features, subfeature, depth,
+				  eval->memo, value);
+}
+
 /* Evaluate an expression */
 static int sensors_eval_expr(const sensors_chip_features *chip_features,
-			     const sensors_expr *expr,
-			     double val, int depth, double *result)
+			     const sensors_bound_prog *bound,
+			     double val, int depth, sensors_memo *memo,
+			     double *result)
 {
-	double res1, res2;
-	int res;
-	const sensors_subfeature *subfeature;
+	struct sensors_eval_data eval;
 
-	if (expr->kind == sensors_kind_val) {
-		*result = expr->data.val;
-		return 0;
-	}
-	if (expr->kind == sensors_kind_source) {
-		*result = val;
-		return 0;
-	}
-	if (expr->kind == sensors_kind_var) {
-		if (!(subfeature = sensors_lookup_subfeature_name(chip_features,
-							    expr->data.var)))
-			return -SENSORS_ERR_NO_ENTRY;
-		return __sensors_get_value(&chip_features->chip,
-					   subfeature->number, depth + 1,
-					   result);
-	}
-	if ((res = sensors_eval_expr(chip_features, expr->data.subexpr.sub1,
-				     val, depth, &res1)))
-		return res;
-	if (expr->data.subexpr.sub2 &&
-	    (res = sensors_eval_expr(chip_features, expr->data.subexpr.sub2,
-				     val, depth, &res2)))
-		return res;
-	switch (expr->data.subexpr.op) {
-	case sensors_add:
-		*result = res1 + res2;
-		return 0;
-	case sensors_sub:
-		*result = res1 - res2;
-		return 0;
-	case sensors_multiply:
-		*result = res1 * res2;
-		return 0;
-	case sensors_divide:
-		if (res2 == 0.0)
-			return -SENSORS_ERR_DIV_ZERO;
-		*result = res1 / res2;
-		return 0;
-	case sensors_negate:
-		*result = -res1;
-		return 0;
-	case sensors_exp:
-		*result = exp(res1);
-		return 0;
-	case sensors_log:
-		if (res1 < 0.0)
-			return -SENSORS_ERR_DIV_ZERO;
-		*result = log(res1);
-		return 0;
-	}
-	return 0;
+	eval.chip_features = chip_features;
+	eval.vars = bound->vars;
+	eval.depth = depth;
+	eval.memo = memo;
+
+	return sensors_run_prog(bound->prog, val, sensors_eval_get_var, &eval,
+				result);
 }
 
 /* Execute all set statements for this particular chip. The chip may not 
@@ -507,13 +1041,18 @@ static int sensors_do_this_chip_sets(const sensors_chip_name *name)
 {
 	const sensors_chip_features *chip_features;
 	sensors_chip *chip;
+	sensors_bound_prog bound;
+	sensors_memo memo = SENSORS_MEMO_INIT;
 	double value;
 	int i;
 	int err = 0, res;
 	const sensors_subfeature *subfeature;
 
-	chip_features = sensors_lookup_chip(name);	/* Can't fail */
+	if (!(chip_features = sensors_lookup_chip_err(name, &res)))
+		return res;
 
+	/* All the set statements share the same memo, so each attribute is
+	   read at most once, unless it is written to */
 	for (chip = NULL; (chip = sensors_for_all_config_chips(name, chip));)
 		for (i = 0; i < chip->sets_count; i++) {
 			subfeature = sensors_lookup_subfeature_name(chip_features,
@@ -526,9 +1065,11 @@ static int sensors_do_this_chip_sets(const sensors_chip_name *name)
 				continue;
 			}
 
-			res = sensors_eval_expr(chip_features,
-						chip->sets[i].value, 0,
-						0, &value);
+			sensors_bind_prog(chip_features, chip->sets[i].prog,
+					  &bound);
+			res = sensors_eval_expr(chip_features, &bound, 0, 0,
+						&memo, &value);
+			free(bound.vars);
 			if (res) {
 				sensors_parse_error_wfn("Error parsing expression",
 						    chip->sets[i].line.filename,
@@ -536,8 +1077,13 @@ static int sensors_do_this_chip_sets(const sensors_chip_name *name)
 				err = res;
 				continue;
 			}
-			if ((res = sensors_set_value(name, subfeature->number,
-						     value))) {
+			if (!(subfeature->flags & SENSORS_MODE_W))
+				res = -SENSORS_ERR_ACCESS_W;
+			else
+				res = sensors_set_memo(chip_features,
+						       subfeature, value,
+						       &memo);
+			if (res) {
 				sensors_parse_error_wfn("Failed to set value",
 						chip->sets[i].line.filename,
 						chip->sets[i].line.lineno);
@@ -545,6 +1091,7 @@ static int sensors_do_this_chip_sets(const sensors_chip_name *name)
 				continue;
 			}
 		}
+	sensors_memo_free(&memo);
 	return err;
 }
 
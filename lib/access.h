@@ -30,4 +30,21 @@
    if there are wildcards. */
 int sensors_chip_name_has_wildcards(const sensors_chip_name *chip);
 
+/* Compare two chips name descriptions, to see whether they could match.
+   Return 0 if it does not match, return 1 if it does match. */
+int sensors_match_chip(const sensors_chip_name *chip1,
+		       const sensors_chip_name *chip2);
+
+/* Discover the features of a chip, and bind the configuration file to
+   them, the first time the chip is used. Safe to call from multiple
+   threads. Returns NULL if the features can't be discovered, in which
+   case the next call tries again. */
+const sensors_chip_features *
+sensors_load_chip(sensors_chip_features *chip);
+
+/* Bind the ignore and compute statements of the configuration file to the
+   detected chips. To be called whenever either of them changes. */
+void sensors_bind_config(void);
+void sensors_unbind_config(sensors_chip_features *chip);
+
 #endif /* def LIB_SENSORS_ACCESS_H */
@@ -0,0 +1,312 @@
+/*
+    alarm.c - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * Many drivers call sysfs_notify() on their alarm attributes when these
+ * change, which makes poll() report POLLPRI on them until they are read
+ * again. All the alarm and fault attributes are in an epoll set, so
+ * waiting for a single file descriptor is enough. As there is no way to
+ * tell whether a driver notifies, attributes are also read periodically
+ * through a timerfd in the same set, until they were seen notifying.
+ */
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sensors.h"
+#include "data.h"
+#include "error.h"
+#include "general.h"
+
+#define ALARM_EVENTS_MAX	64	/* Per call of epoll_wait() */
+#define ALARM_TIMER		UINT32_MAX	/* epoll data of the timer */
+
+struct alarm_attr {
+	const sensors_chip_name *name;
+	int subfeat_nr;
+	int fd;			/* -1 once the attribute is gone */
+	int notifies;		/* Seen notifying, no need to poll */
+	int pending;		/* Changed, not reported yet */
+	double value;
+};
+
+static sensors_context *alarm_ctx;
+static struct alarm_attr *alarms;
+static int alarms_count;
+static int alarms_max;
+static int alarms_polled;	/* Attributes which don't notify (yet) */
+static int alarm_epoll_fd = -1;
+static int alarm_timer_fd = -1;
+static int alarm_interval;	/* In ms, 0 if not polling */
+static int alarm_timer_armed;
+
+static int alarm_is_alarm(const sensors_subfeature *subfeature)
+{
+	const char *p = strrchr(subfeature->name, '_');
+
+	return (subfeature->flags & SENSORS_MODE_R) && p &&
+	       (!strcmp(p, "_alarm") || !strcmp(p, "_fault"));
+}
+
+/* Read the attribute again, which also acknowledges a notification.
+   Returns 0 on success, -1 with errno set on error. */
+static int alarm_read(struct alarm_attr *alarm, double *value)
+{
+	char buf[32], *endp;
+	ssize_t len;
+
+	len = pread(alarm->fd, buf, sizeof(buf) - 1, 0);
+	if (len < 0)
+		return -1;
+	buf[len] = '\0';
+	*value = strtod(buf, &endp);
+	if (endp == buf) {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+/* Arm the timer if some attributes must be polled, disarm it otherwise */
+static void alarm_set_timer(void)
+{
+	struct itimerspec its;
+	int armed = alarm_interval && alarms_polled;
+
+	if (alarm_timer_fd < 0 || armed == alarm_timer_armed)
+		return;
+
+	memset(&its, 0, sizeof(its));
+	if (armed) {
+		its.it_interval.tv_sec = alarm_interval / 1000;
+		its.it_interval.tv_nsec = (alarm_interval % 1000) * 1000000L;
+		its.it_value = its.it_interval;
+	}
+	if (!timerfd_settime(alarm_timer_fd, 0, &its, NULL))
+		alarm_timer_armed = armed;
+}
+
+static void alarm_update(struct alarm_attr *alarm)
+{
+	double value;
+
+	if (alarm_read(alarm, &value)) {
+		if (errno == ENODEV || errno == ENOENT) {
+			/* The device is gone */
+			epoll_ctl(alarm_epoll_fd, EPOLL_CTL_DEL, alarm->fd,
+				  NULL);
+			close(alarm->fd);
+			alarm->fd = -1;
+			if (!alarm->notifies)
+				alarms_polled--;
+		} else if (alarm->notifies) {
+			/* The notification can't be acknowledged, so it
+			   would be reported again and again */
+			epoll_ctl(alarm_epoll_fd, EPOLL_CTL_DEL, alarm->fd,
+				  NULL);
+			alarm->notifies = 0;
+			alarms_polled++;
+		}
+		return;
+	}
+	if (value != alarm->value) {
+		alarm->value = value;
+		alarm->pending = 1;
+	}
+}
+
+/* Open and register the alarm attributes of a chip */
+static void alarm_add_chip(const sensors_chip_name *name)
+{
+	const sensors_feature *feature;
+	const sensors_subfeature *subfeature;
+	struct alarm_attr alarm;
+	struct epoll_event ev;
+	char path[NAME_MAX];
+	int nr = 0, snr;
+
+	while ((feature = sensors_get_features_ctx(alarm_ctx, name, &nr))) {
+		snr = 0;
+		while ((subfeature = sensors_get_all_subfeatures_ctx(alarm_ctx,
+						name, feature, &snr))) {
+			if (!alarm_is_alarm(subfeature))
+				continue;
+
+			snprintf(path, NAME_MAX, "%s/%s", name->path,
+				 subfeature->name);
+			memset(&alarm, 0, sizeof(alarm));
+			alarm.name = name;
+			alarm.subfeat_nr = subfeature->number;
+			alarm.fd = open(path, O_RDONLY | O_CLOEXEC);
+			if (alarm.fd < 0)
+				continue;
+
+			/* Notifications only come after a first read */
+			if (alarm_read(&alarm, &alarm.value)) {
+				close(alarm.fd);
+				continue;
+			}
+
+			/* Only sysfs files can be polled, those of other
+			   file systems are just read periodically */
+			ev.events = EPOLLPRI;
+			ev.data.u32 = alarms_count;
+			epoll_ctl(alarm_epoll_fd, EPOLL_CTL_ADD, alarm.fd, &ev);
+
+			sensors_add_array_el(&alarm, &alarms, &alarms_count,
+					     &alarms_max,
+					     sizeof(struct alarm_attr));
+			alarms_polled++;
+		}
+	}
+}
+
+int sensors_alarm_open(int interval)
+{
+	const sensors_chip_name *name;
+	struct epoll_event ev;
+	int nr = 0;
+
+	if (alarm_epoll_fd >= 0)
+		return alarm_epoll_fd;
+
+	alarm_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (alarm_epoll_fd < 0)
+		return -SENSORS_ERR_KERNEL;
+
+	if (interval > 0) {
+		alarm_timer_fd = timerfd_create(CLOCK_MONOTONIC,
+						TFD_NONBLOCK | TFD_CLOEXEC);
+		ev.events = EPOLLIN;
+		ev.data.u32 = ALARM_TIMER;
+		if (alarm_timer_fd < 0 ||
+		    epoll_ctl(alarm_epoll_fd, EPOLL_CTL_ADD, alarm_timer_fd,
+			      &ev) < 0) {
+			sensors_alarm_close();
+			return -SENSORS_ERR_KERNEL;
+		}
+		alarm_interval = interval;
+	}
+
+	/* Chip names must remain valid even if another context gets
+	   published */
+	alarm_ctx = sensors_context_acquire();
+	while ((name = sensors_get_detected_chips_ctx(alarm_ctx, NULL, &nr)))
+		alarm_add_chip(name);
+	alarm_set_timer();
+
+	return alarm_epoll_fd;
+}
+
+/* Return the pending changes, at most count of them */
+static int alarm_report(sensors_alarm_event *events, int count)
+{
+	int i, n = 0;
+
+	for (i = 0; i < alarms_count && n < count; i++) {
+		if (!alarms[i].pending)
+			continue;
+		alarms[i].pending = 0;
+		events[n].name = alarms[i].name;
+		events[n].subfeat_nr = alarms[i].subfeat_nr;
+		events[n].value = alarms[i].value;
+		n++;
+	}
+	return n;
+}
+
+int sensors_alarm_drain(sensors_alarm_event *events, int count)
+{
+	struct epoll_event ev[ALARM_EVENTS_MAX];
+	struct alarm_attr *alarm;
+	uint64_t expirations;
+	int i, n;
+
+	if (alarm_epoll_fd < 0)
+		return -SENSORS_ERR_KERNEL;
+
+	for (;;) {
+		n = epoll_wait(alarm_epoll_fd, ev, ALARM_EVENTS_MAX, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -SENSORS_ERR_KERNEL;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (ev[i].data.u32 == ALARM_TIMER) {
+				if (read(alarm_timer_fd, &expirations,
+					 sizeof(expirations)) < 0)
+					continue;
+				for (alarm = alarms;
+				     alarm < alarms + alarms_count; alarm++)
+					if (alarm->fd >= 0 && !alarm->notifies)
+						alarm_update(alarm);
+				continue;
+			}
+
+			alarm = &alarms[ev[i].data.u32];
+			if (alarm->fd < 0)
+				continue;
+			if (!alarm->notifies) {
+				alarm->notifies = 1;
+				alarms_polled--;
+			}
+			alarm_update(alarm);
+		}
+		if (n < ALARM_EVENTS_MAX)
+			break;
+	}
+
+	alarm_set_timer();
+
+	return alarm_report(events, count);
+}
+
+void sensors_alarm_close(void)
+{
+	int i;
+
+	for (i = 0; i < alarms_count; i++)
+		if (alarms[i].fd >= 0)
+			close(alarms[i].fd);
+	free(alarms);
+	alarms = NULL;
+	alarms_count = alarms_max = alarms_polled = 0;
+	alarm_interval = alarm_timer_armed = 0;
+
+	if (alarm_ctx) {
+		sensors_context_release(alarm_ctx);
+		alarm_ctx = NULL;
+	}
+	if (alarm_timer_fd >= 0) {
+		close(alarm_timer_fd);
+		alarm_timer_fd = -1;
+	}
+	if (alarm_epoll_fd >= 0) {
+		close(alarm_epoll_fd);
+		alarm_epoll_fd = -1;
+	}
+}
@@ -0,0 +1,192 @@
+/*
+    arena.c - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "error.h"
+#include "data.h"
+#include "arena.h"
+
+/* Large enough to hold all chips of a desktop system in one block, small
+   enough not to waste much on embedded systems. Larger allocations get a
+   block of their own. */
+#define ARENA_BLOCK_SIZE	(32 * 1024)
+#define ARENA_ALIGN		16
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	/* Data follows, aligned */
+};
+
+#define ARENA_HEADER_SIZE	((sizeof(struct arena_block) + ARENA_ALIGN - 1) \
+				 & ~(size_t)(ARENA_ALIGN - 1))
+
+/* Lazy discovery of chip features happens in any thread */
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *arena_alloc_locked(struct sensors_arena *arena, size_t size)
+{
+	struct arena_block *block;
+	size_t block_size;
+	void *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (!arena->head || arena->head->used + size > arena->head->size) {
+		block_size = size > ARENA_BLOCK_SIZE / 4 ? size :
+			     ARENA_BLOCK_SIZE - ARENA_HEADER_SIZE;
+		block = calloc(1, ARENA_HEADER_SIZE + block_size);
+		if (!block)
+			sensors_fatal_error(__func__, "Out of memory");
+		block->size = block_size;
+		block->used = 0;
+
+		/* Keep filling the current block if this one is for a
+		   single large allocation */
+		if (arena->head && block_size == size) {
+			block->next = arena->head->next;
+			arena->head->next = block;
+			block->used = size;
+			return (char *)block + ARENA_HEADER_SIZE;
+		}
+		block->next = arena->head;
+		arena->head = block;
+	}
+
+	p = (char *)arena->head + ARENA_HEADER_SIZE + arena->head->used;
+	arena->head->used += size;
+	return p;
+}
+
+void *sensors_arena_alloc(size_t size)
+{
+	void *p;
+
+	pthread_mutex_lock(&arena_lock);
+	p = arena_alloc_locked(&sensors_this_context()->arena, size);
+	pthread_mutex_unlock(&arena_lock);
+
+	return p;
+}
+
+static char *arena_strndup_locked(struct sensors_arena *arena,
+				  const char *s, size_t len)
+{
+	char *p;
+
+	p = arena_alloc_locked(arena, len + 1);
+	memcpy(p, s, len);	/* Already NUL-terminated */
+	return p;
+}
+
+char *sensors_arena_strdup(const char *s)
+{
+	char *p;
+
+	pthread_mutex_lock(&arena_lock);
+	p = arena_strndup_locked(&sensors_this_context()->arena, s,
+				 strlen(s));
+	pthread_mutex_unlock(&arena_lock);
+
+	return p;
+}
+
+static unsigned int intern_hash(const char *s, size_t len)
+{
+	unsigned int hash = 2166136261U;
+
+	while (len--)
+		hash = (hash ^ (unsigned char)*s++) * 16777619U;
+	return hash;
+}
+
+static void intern_grow_locked(struct sensors_arena *arena)
+{
+	char **old_table = arena->intern_table;
+	unsigned int i, slot, old_size = arena->intern_size;
+	unsigned int mask;
+
+	arena->intern_size = old_size ? old_size * 2 : 256;
+	arena->intern_table = calloc(arena->intern_size, sizeof(char *));
+	if (!arena->intern_table)
+		sensors_fatal_error(__func__, "Out of memory");
+	mask = arena->intern_size - 1;
+
+	for (i = 0; i < old_size; i++) {
+		if (!old_table[i])
+			continue;
+		slot = intern_hash(old_table[i], strlen(old_table[i]));
+		for (slot &= mask; arena->intern_table[slot];
+		     slot = (slot + 1) & mask)
+			;
+		arena->intern_table[slot] = old_table[i];
+	}
+	free(old_table);
+}
+
+char *sensors_intern_n(const char *s, size_t len)
+{
+	struct sensors_arena *arena = &sensors_this_context()->arena;
+	unsigned int slot, mask;
+	char *p;
+
+	pthread_mutex_lock(&arena_lock);
+
+	/* Keep the load factor at or below 1/2 */
+	if (2 * (arena->intern_count + 1) > arena->intern_size)
+		intern_grow_locked(arena);
+	mask = arena->intern_size - 1;
+
+	slot = intern_hash(s, len) & mask;
+	for (; (p = arena->intern_table[slot]); slot = (slot + 1) & mask)
+		if (!strncmp(p, s, len) && !p[len])
+			goto exit;
+
+	p = arena_strndup_locked(arena, s, len);
+	arena->intern_table[slot] = p;
+	arena->intern_count++;
+
+exit:
+	pthread_mutex_unlock(&arena_lock);
+	return p;
+}
+
+char *sensors_intern(const char *s)
+{
+	return sensors_intern_n(s, strlen(s));
+}
+
+void sensors_arena_free(void)
+{
+	struct sensors_arena *arena = &sensors_this_context()->arena;
+	struct arena_block *block;
+
+	pthread_mutex_lock(&arena_lock);
+	while ((block = arena->head)) {
+		arena->head = block->next;
+		free(block);
+	}
+	free(arena->intern_table);
+	arena->intern_table = NULL;
+	arena->intern_size = arena->intern_count = 0;
+	pthread_mutex_unlock(&arena_lock);
+}
@@ -0,0 +1,55 @@
+/*
+    arena.h - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#ifndef LIB_SENSORS_ARENA_H
+#define LIB_SENSORS_ARENA_H
+
+#include <stddef.h>
+
+/* Everything discovered about the chips lives in a single arena per
+   context, which is freed at once by sensors_cleanup(). Memory of the
+   arena is never freed individually. All these functions work on the
+   arena of the current context, are thread-safe, and never fail: they
+   call sensors_fatal_error() if out of memory. */
+
+struct sensors_arena {
+	struct arena_block *head;
+	/* Hash set of the interned strings, with open addressing and
+	   linear probing. The size is a power of 2. */
+	char **intern_table;
+	unsigned int intern_size;
+	unsigned int intern_count;
+};
+
+/* Allocate zeroed memory, aligned for any type */
+void *sensors_arena_alloc(size_t size);
+
+/* Copy a string into the arena */
+char *sensors_arena_strdup(const char *s);
+
+/* Return the copy of the first len characters of s in the arena, the same
+   one for equal strings, so names which are found on every chip are only
+   stored once. The result must not be modified. */
+char *sensors_intern_n(const char *s, size_t len);
+char *sensors_intern(const char *s);
+
+/* Free the arena and forget about interned strings */
+void sensors_arena_free(void);
+
+#endif /* def LIB_SENSORS_ARENA_H */
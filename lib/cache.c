@@ -0,0 +1,636 @@
+/*
+    cache.c - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/* this define needed for mkostemp() */
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include "sensors.h"
+#include "data.h"
+#include "error.h"
+#include "access.h"
+#include "general.h"
+#include "sysfs.h"
+#include "arena.h"
+#include "cache.h"
+
+/*
+ * The discovery cache holds everything sensors_read_sysfs_bus() and
+ * sensors_read_sysfs_chips() found, and the features of all the chips.
+ * It is valid as long as the system wasn't rebooted and the directories
+ * of the device classes below didn't change: any chip or bus which comes
+ * or goes adds or removes a class directory, and the driver of a chip
+ * can't be replaced without doing so.
+ *
+ * The file is a header, followed by arrays of fixed size records and the
+ * strings they refer to, by offset. It is mapped and checked entirely
+ * before anything is taken from it, so a damaged file is merely ignored.
+ */
+
+#define CACHE_MAGIC	0x43534d4c	/* "LMSC" on little endian */
+#define CACHE_VERSION	1
+
+/* The class directories which make the topology */
+static const char *const cache_classes[] = {
+	"hwmon",
+	"i2c-adapter",
+};
+
+struct cache_header {
+	uint32_t magic;
+	uint32_t version;
+	char lib_version[16];
+	char boot_id[40];
+	uint32_t size;		/* Of the whole file */
+	uint32_t dirs_count;
+	uint32_t chips_count;
+	uint32_t busses_count;
+	uint32_t features_count;
+	uint32_t subfeatures_count;
+	uint32_t strings_size;
+	uint32_t reserved;
+};
+
+struct cache_dir {
+	uint64_t ino;
+	int64_t ctime_sec;
+	int64_t ctime_nsec;
+	uint32_t name;
+	uint32_t class;
+};
+
+/* The features and subfeatures of each chip are contiguous. Offsets of
+   features and subfeatures are relative to the first of the chip. */
+struct cache_chip {
+	uint32_t prefix;
+	uint32_t path;
+	int16_t bus_type;
+	int16_t bus_nr;
+	int32_t addr;
+	uint32_t first_feature;
+	uint32_t features_count;
+	uint32_t first_subfeature;
+	uint32_t subfeatures_count;
+};
+
+struct cache_bus {
+	uint32_t adapter;
+	int16_t type;
+	int16_t nr;
+};
+
+struct cache_feature {
+	uint32_t name;
+	int32_t type;
+	uint32_t first_subfeature;
+};
+
+struct cache_subfeature {
+	uint32_t name;
+	int32_t type;
+	uint32_t mapping;
+	uint32_t flags;
+};
+
+/* Pointers into a mapped cache file */
+struct cache_image {
+	const struct cache_header *header;
+	const struct cache_dir *dirs;
+	const struct cache_chip *chips;
+	const struct cache_bus *busses;
+	const struct cache_feature *features;
+	const struct cache_subfeature *subfeatures;
+	const char *strings;
+};
+
+/* Growable string table, for writing */
+struct cache_strings {
+	char *data;
+	uint32_t size;
+	uint32_t max;
+};
+
+static int read_boot_id(char *boot_id, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -SENSORS_ERR_KERNEL;
+	len = read(fd, boot_id, size - 1);
+	close(fd);
+	if (len <= 0)
+		return -SENSORS_ERR_KERNEL;
+
+	boot_id[len] = '\0';
+	boot_id[strcspn(boot_id, "\n")] = '\0';
+	return 0;
+}
+
+void sensors_free_topology(sensors_topology *topo)
+{
+	int i;
+
+	for (i = 0; i < topo->dirs_count; i++)
+		free(topo->dirs[i].name);
+	free(topo->dirs);
+	topo->dirs = NULL;
+	topo->dirs_count = topo->dirs_max = 0;
+}
+
+int sensors_scan_topology(sensors_topology *topo)
+{
+	char path[NAME_MAX];
+	sensors_topology_dir entry;
+	struct dirent *ent;
+	struct stat st;
+	DIR *dir;
+	int i;
+
+	memset(topo, 0, sizeof(*topo));
+	if (read_boot_id(topo->boot_id, sizeof(topo->boot_id)))
+		return -SENSORS_ERR_KERNEL;
+
+	for (i = 0; i < (int)ARRAY_SIZE(cache_classes); i++) {
+		snprintf(path, NAME_MAX, "%s/class/%s", sensors_sysfs_mount,
+			 cache_classes[i]);
+		if (!(dir = opendir(path))) {
+			/* No i2c-adapter class without i2c-core, but no
+			   caching for kernels without the hwmon class */
+			if (i && errno == ENOENT)
+				continue;
+			goto exit_free;
+		}
+
+		while ((ent = readdir(dir))) {
+			if (ent->d_name[0] == '.')	/* skip hidden entries */
+				continue;
+			/* Of the device directory, not of the link */
+			if (fstatat(dirfd(dir), ent->d_name, &st, 0) < 0) {
+				closedir(dir);
+				goto exit_free;
+			}
+
+			entry.name = strdup(ent->d_name);
+			if (!entry.name)
+				sensors_fatal_error(__func__, "Out of memory");
+			entry.class = i;
+			entry.ino = st.st_ino;
+			entry.ctime_sec = st.st_ctim.tv_sec;
+			entry.ctime_nsec = st.st_ctim.tv_nsec;
+			sensors_add_array_el(&entry, &topo->dirs,
+					     &topo->dirs_count, &topo->dirs_max,
+					     sizeof(sensors_topology_dir));
+		}
+		closedir(dir);
+	}
+
+	return 0;
+
+exit_free:
+	sensors_free_topology(topo);
+	return -SENSORS_ERR_KERNEL;
+}
+
+/* Returns the string at offset off, or NULL if it is out of bounds. The
+   string table is known to end with a NUL. */
+static const char *cache_string(const struct cache_image *img, uint32_t off)
+{
+	if (off >= img->header->strings_size)
+		return NULL;
+	return img->strings + off;
+}
+
+/* Check the features and subfeatures of a chip, for them to be usable as
+   they are by the rest of the library */
+static int cache_check_chip(const struct cache_image *img,
+			    const struct cache_chip *chip)
+{
+	const struct cache_feature *features;
+	const struct cache_subfeature *subfeatures;
+	uint32_t i, f;
+	int found = 0;
+
+	if (!cache_string(img, chip->prefix) || !cache_string(img, chip->path))
+		return 0;
+	if ((uint64_t)chip->first_feature + chip->features_count >
+	    img->header->features_count ||
+	    (uint64_t)chip->first_subfeature + chip->subfeatures_count >
+	    img->header->subfeatures_count ||
+	    !chip->features_count != !chip->subfeatures_count)
+		return 0;
+
+	features = img->features + chip->first_feature;
+	subfeatures = img->subfeatures + chip->first_subfeature;
+	for (f = 0; f < chip->features_count; f++)
+		if (!cache_string(img, features[f].name) ||
+		    features[f].type < 0 ||
+		    features[f].type >= SENSORS_FEATURE_MAX)
+			return 0;
+
+	/* Subfeatures are grouped by feature, in the order of the features,
+	   and each feature has at least one */
+	for (i = 0, f = 0; i < chip->subfeatures_count; i++) {
+		if (subfeatures[i].mapping != f) {
+			if (!found || subfeatures[i].mapping != f + 1 ||
+			    f + 1 >= chip->features_count)
+				return 0;
+			f++;
+			found = 0;
+		}
+		if (!found && features[f].first_subfeature != i)
+			return 0;
+		found = 1;
+
+		if (!cache_string(img, subfeatures[i].name) ||
+		    subfeatures[i].type < 0 ||
+		    subfeatures[i].type >> 8 != features[f].type ||
+		    !sensors_check_subfeature_type(subfeatures[i].type))
+			return 0;
+	}
+	return !chip->features_count || f == chip->features_count - 1;
+}
+
+/* Set up img from a mapped file of size bytes. Returns 1 if the file is
+   valid for topo, 0 otherwise. */
+static int cache_check(struct cache_image *img, const char *map, size_t size,
+		       const sensors_topology *topo)
+{
+	const struct cache_header *header = (const void *)map;
+	const struct cache_dir *dir;
+	const char *name;
+	uint64_t expected;
+	uint32_t i;
+
+	if (size < sizeof(*header) ||
+	    header->magic != CACHE_MAGIC ||
+	    header->version != CACHE_VERSION ||
+	    header->size != size ||
+	    strncmp(header->lib_version, libsensors_version,
+		    sizeof(header->lib_version)) ||
+	    strncmp(header->boot_id, topo->boot_id, sizeof(header->boot_id)))
+		return 0;
+
+	expected = sizeof(*header) +
+		   (uint64_t)header->dirs_count * sizeof(struct cache_dir) +
+		   (uint64_t)header->chips_count * sizeof(struct cache_chip) +
+		   (uint64_t)header->busses_count * sizeof(struct cache_bus) +
+		   (uint64_t)header->features_count *
+		   sizeof(struct cache_feature) +
+		   (uint64_t)header->subfeatures_count *
+		   sizeof(struct cache_subfeature) +
+		   header->strings_size;
+	if (expected != size || !header->strings_size ||
+	    map[size - 1] != '\0')
+		return 0;
+
+	img->header = header;
+	img->dirs = (const void *)(header + 1);
+	img->chips = (const void *)(img->dirs + header->dirs_count);
+	img->busses = (const void *)(img->chips + header->chips_count);
+	img->features = (const void *)(img->busses + header->busses_count);
+	img->subfeatures = (const void *)(img->features +
+					  header->features_count);
+	img->strings = (const void *)(img->subfeatures +
+				      header->subfeatures_count);
+
+	/* Same topology, in the same order */
+	if (header->dirs_count != (uint32_t)topo->dirs_count)
+		return 0;
+	for (i = 0; i < header->dirs_count; i++) {
+		dir = &img->dirs[i];
+		name = cache_string(img, dir->name);
+		if (!name || strcmp(name, topo->dirs[i].name) ||
+		    dir->class != (uint32_t)topo->dirs[i].class ||
+		    dir->ino != topo->dirs[i].ino ||
+		    dir->ctime_sec != topo->dirs[i].ctime_sec ||
+		    dir->ctime_nsec != topo->dirs[i].ctime_nsec)
+			return 0;
+	}
+
+	for (i = 0; i < header->busses_count; i++)
+		if (!cache_string(img, img->busses[i].adapter))
+			return 0;
+	for (i = 0; i < header->chips_count; i++)
+		if (!cache_check_chip(img, &img->chips[i]))
+			return 0;
+
+	return 1;
+}
+
+static char *cache_strdup(const struct cache_image *img, uint32_t off)
+{
+	char *s;
+
+	s = strdup(cache_string(img, off));
+	if (!s)
+		sensors_fatal_error(__func__, "Out of memory");
+	return s;
+}
+
+static char *cache_intern(const struct cache_image *img, uint32_t off)
+{
+	return sensors_intern(cache_string(img, off));
+}
+
+static int cache_match_filter(const sensors_chip_name *name,
+			      const sensors_chip_name *match, int count)
+{
+	int i;
+
+	if (!match)
+		return 1;
+	for (i = 0; i < count; i++)
+		if (sensors_match_chip(name, &match[i]))
+			return 1;
+	return 0;
+}
+
+/* Add a chip of the cache to sensors_proc_chips, with its features, if it
+   matches the filter */
+static void cache_add_chip(const struct cache_image *img,
+			   const struct cache_chip *chip,
+			   const sensors_chip_name *match, int count)
+{
+	const struct cache_feature *feature;
+	const struct cache_subfeature *subfeature;
+	sensors_chip_features entry;
+	uint32_t i;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.chip.prefix = cache_intern(img, chip->prefix);
+	entry.chip.bus.type = chip->bus_type;
+	entry.chip.bus.nr = chip->bus_nr;
+	entry.chip.addr = chip->addr;
+	if (!cache_match_filter(&entry.chip, match, count))
+		return;
+	entry.chip.path = sensors_arena_strdup(cache_string(img, chip->path));
+
+	/* Left for sensors_read_sysfs_chip_features() */
+	if (!chip->subfeatures_count) {
+		sensors_add_proc_chips(&entry);
+		return;
+	}
+
+	entry.feature_count = chip->features_count;
+	entry.subfeature_count = chip->subfeatures_count;
+	entry.feature = sensors_arena_alloc(entry.feature_count *
+					    sizeof(sensors_feature));
+	entry.subfeature = sensors_arena_alloc(entry.subfeature_count *
+					       sizeof(sensors_subfeature));
+
+	for (i = 0; i < chip->features_count; i++) {
+		feature = &img->features[chip->first_feature + i];
+		entry.feature[i].name = cache_intern(img, feature->name);
+		entry.feature[i].number = i;
+		entry.feature[i].type = feature->type;
+		entry.feature[i].first_subfeature = feature->first_subfeature;
+	}
+	for (i = 0; i < chip->subfeatures_count; i++) {
+		subfeature = &img->subfeatures[chip->first_subfeature + i];
+		entry.subfeature[i].name = cache_intern(img,
+							subfeature->name);
+		entry.subfeature[i].number = i;
+		entry.subfeature[i].type = subfeature->type;
+		entry.subfeature[i].mapping = subfeature->mapping;
+		entry.subfeature[i].flags = subfeature->flags;
+	}
+
+	sensors_init_chip_tables(&entry);
+	sensors_add_proc_chips(&entry);
+}
+
+int sensors_read_cache(const char *file, const sensors_topology *topo,
+		       const sensors_chip_name *match, int count)
+{
+	struct cache_image img;
+	sensors_bus bus;
+	struct stat st;
+	void *map;
+	uint32_t i;
+	int fd, valid;
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -SENSORS_ERR_KERNEL;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct cache_header)
+	    || st.st_size > UINT32_MAX) {
+		close(fd);
+		return -SENSORS_ERR_PARSE;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -SENSORS_ERR_KERNEL;
+
+	valid = cache_check(&img, map, st.st_size, topo);
+	if (valid) {
+		for (i = 0; i < img.header->busses_count; i++) {
+			bus.adapter = cache_strdup(&img,
+						   img.busses[i].adapter);
+			bus.bus.type = img.busses[i].type;
+			bus.bus.nr = img.busses[i].nr;
+			sensors_add_proc_bus(&bus);
+		}
+
+		for (i = 0; i < img.header->chips_count; i++)
+			cache_add_chip(&img, &img.chips[i], match, count);
+		sensors_index_proc_chips();
+	}
+	munmap(map, st.st_size);
+
+	return valid ? 0 : -SENSORS_ERR_PARSE;
+}
+
+/* Returns the offset of the string in the table */
+static uint32_t cache_add_string(struct cache_strings *strings,
+				 const char *s)
+{
+	uint32_t off = strings->size, len = strlen(s) + 1;
+
+	while (strings->size + len > strings->max) {
+		strings->max = strings->max ? strings->max * 2 : 4096;
+		strings->data = realloc(strings->data, strings->max);
+		if (!strings->data)
+			sensors_fatal_error(__func__, "Out of memory");
+	}
+	memcpy(strings->data + off, s, len);
+	strings->size += len;
+	return off;
+}
+
+static int write_all(int fd, const void *buf, size_t count)
+{
+	const char *p = buf;
+	ssize_t len;
+
+	while (count) {
+		len = write(fd, p, count);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += len;
+		count -= len;
+	}
+	return 0;
+}
+
+void sensors_write_cache(const char *file, const sensors_topology *topo)
+{
+	struct cache_header header;
+	struct cache_dir *dirs;
+	struct cache_chip *chips;
+	struct cache_bus *busses;
+	struct cache_feature *features;
+	struct cache_subfeature *subfeatures;
+	struct cache_strings strings = { NULL, 0, 0 };
+	const sensors_chip_features *chip;
+	char *tmp;
+	size_t len;
+	int i, j, fd, err, nf = 0, nsf = 0;
+
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		nf += sensors_proc_chips[i]->feature_count;
+		nsf += sensors_proc_chips[i]->subfeature_count;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	/* NUL-padded as header was cleared, but not NUL-terminated if it
+	   fills the field, which is compared with strncmp() */
+	len = strlen(libsensors_version);
+	memcpy(header.lib_version, libsensors_version,
+	       len < sizeof(header.lib_version) ? len :
+	       sizeof(header.lib_version));
+	strncpy(header.boot_id, topo->boot_id, sizeof(header.boot_id));
+	header.dirs_count = topo->dirs_count;
+	header.chips_count = sensors_proc_chips_count;
+	header.busses_count = sensors_proc_bus_count;
+	header.features_count = nf;
+	header.subfeatures_count = nsf;
+
+	dirs = calloc(topo->dirs_count + 1, sizeof(struct cache_dir));
+	chips = calloc(sensors_proc_chips_count + 1, sizeof(struct cache_chip));
+	busses = calloc(sensors_proc_bus_count + 1, sizeof(struct cache_bus));
+	features = calloc(nf + 1, sizeof(struct cache_feature));
+	subfeatures = calloc(nsf + 1, sizeof(struct cache_subfeature));
+	if (!dirs || !chips || !busses || !features || !subfeatures)
+		sensors_fatal_error(__func__, "Out of memory");
+
+	for (i = 0; i < topo->dirs_count; i++) {
+		dirs[i].ino = topo->dirs[i].ino;
+		dirs[i].ctime_sec = topo->dirs[i].ctime_sec;
+		dirs[i].ctime_nsec = topo->dirs[i].ctime_nsec;
+		dirs[i].name = cache_add_string(&strings, topo->dirs[i].name);
+		dirs[i].class = topo->dirs[i].class;
+	}
+
+	for (i = 0; i < sensors_proc_bus_count; i++) {
+		busses[i].adapter = cache_add_string(&strings,
+						sensors_proc_bus[i].adapter);
+		busses[i].type = sensors_proc_bus[i].bus.type;
+		busses[i].nr = sensors_proc_bus[i].bus.nr;
+	}
+
+	nf = nsf = 0;
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		chip = sensors_proc_chips[i];
+		chips[i].prefix = cache_add_string(&strings, chip->chip.prefix);
+		chips[i].path = cache_add_string(&strings, chip->chip.path);
+		chips[i].bus_type = chip->chip.bus.type;
+		chips[i].bus_nr = chip->chip.bus.nr;
+		chips[i].addr = chip->chip.addr;
+		chips[i].first_feature = nf;
+		chips[i].features_count = chip->feature_count;
+		chips[i].first_subfeature = nsf;
+		chips[i].subfeatures_count = chip->subfeature_count;
+
+		for (j = 0; j < chip->feature_count; j++, nf++) {
+			features[nf].name = cache_add_string(&strings,
+						chip->feature[j].name);
+			features[nf].type = chip->feature[j].type;
+			features[nf].first_subfeature =
+				chip->feature[j].first_subfeature;
+		}
+		for (j = 0; j < chip->subfeature_count; j++, nsf++) {
+			subfeatures[nsf].name = cache_add_string(&strings,
+						chip->subfeature[j].name);
+			subfeatures[nsf].type = chip->subfeature[j].type;
+			subfeatures[nsf].mapping = chip->subfeature[j].mapping;
+			subfeatures[nsf].flags = chip->subfeature[j].flags;
+		}
+	}
+	/* Never empty, see cache_check() */
+	cache_add_string(&strings, "");
+	header.strings_size = strings.size;
+	header.size = sizeof(header) +
+		      header.dirs_count * sizeof(struct cache_dir) +
+		      header.chips_count * sizeof(struct cache_chip) +
+		      header.busses_count * sizeof(struct cache_bus) +
+		      header.features_count * sizeof(struct cache_feature) +
+		      header.subfeatures_count *
+		      sizeof(struct cache_subfeature) +
+		      header.strings_size;
+
+	/* Replace the file atomically, readers see either version */
+	tmp = malloc(strlen(file) + 8);
+	if (!tmp)
+		sensors_fatal_error(__func__, "Out of memory");
+	sprintf(tmp, "%s.XXXXXX", file);
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd >= 0) {
+		err = fchmod(fd, 0644) ||
+		      write_all(fd, &header, sizeof(header)) ||
+		      write_all(fd, dirs, header.dirs_count *
+				sizeof(struct cache_dir)) ||
+		      write_all(fd, chips, header.chips_count *
+				sizeof(struct cache_chip)) ||
+		      write_all(fd, busses, header.busses_count *
+				sizeof(struct cache_bus)) ||
+		      write_all(fd, features, header.features_count *
+				sizeof(struct cache_feature)) ||
+		      write_all(fd, subfeatures, header.subfeatures_count *
+				sizeof(struct cache_subfeature)) ||
+		      write_all(fd, strings.data, strings.size);
+		err |= close(fd);
+		if (err || rename(tmp, file))
+			unlink(tmp);
+	}
+
+	free(tmp);
+	free(strings.data);
+	free(subfeatures);
+	free(features);
+	free(busses);
+	free(chips);
+	free(dirs);
+}
@@ -0,0 +1,65 @@
+/*
+    cache.h - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#ifndef LIB_SENSORS_CACHE_H
+#define LIB_SENSORS_CACHE_H
+
+#include <stdint.h>
+#include "data.h"
+
+/* A directory of the sysfs device classes the detected chips and busses
+   depend on */
+typedef struct sensors_topology_dir {
+	char *name;		/* Relative to the class directory */
+	int class;		/* Index in the class list, see cache.c */
+	uint64_t ino;
+	int64_t ctime_sec;
+	int64_t ctime_nsec;
+} sensors_topology_dir;
+
+/* What the discovery cache is valid for: the current boot, and the class
+   directories as they are now */
+typedef struct sensors_topology {
+	char boot_id[40];
+	sensors_topology_dir *dirs;
+	int dirs_count;
+	int dirs_max;
+} sensors_topology;
+
+/* Take a snapshot of the topology. Returns 0 on success, <0 if it can't
+   be determined, in which case the cache can't be used. */
+int sensors_scan_topology(sensors_topology *topo);
+
+void sensors_free_topology(sensors_topology *topo);
+
+/* Fill sensors_proc_bus and sensors_proc_chips from the cache file, if it
+   was written for the same topology. Only the chips matching at least one
+   of the count names of match are kept, if match is not NULL. Returns 0 on
+   success, <0 if the chips must be discovered, in which case nothing was
+   changed. */
+int sensors_read_cache(const char *file, const sensors_topology *topo,
+		       const sensors_chip_name *match, int count);
+
+/* Write the cache file, from all the detected chips, which must have been
+   loaded. The topology must have been taken before the chips were
+   detected. Errors are silently ignored, there simply won't be any
+   cache. */
+void sensors_write_cache(const char *file, const sensors_topology *topo);
+
+#endif /* def LIB_SENSORS_CACHE_H */
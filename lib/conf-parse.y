@@ -31,6 +31,7 @@
 #include "conf.h"
 #include "access.h"
 #include "init.h"
+#include "expr.h"
 
 static void sensors_yyerror(const char *err);
 static sensors_expr *malloc_expr(void);
@@ -164,6 +165,7 @@ set_statement:	  SET function_name expression
 		    new_el.line = $1;
 		    new_el.name = $2;
 		    new_el.value = $3;
+		    new_el.prog = sensors_compile_expr($3);
 		    set_add_el(&new_el);
 		  }
 ;
@@ -181,6 +183,8 @@ compute_statement:	  COMPUTE function_name expression ',' expression
 			    new_el.name = $2;
 			    new_el.from_proc = $3;
 			    new_el.to_proc = $5;
+			    new_el.from_prog = sensors_compile_expr($3);
+			    new_el.to_prog = sensors_compile_expr($5);
 			    compute_add_el(&new_el);
 			  }
 ;
@@ -0,0 +1,265 @@
+/*
+    context.c - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include "sensors.h"
+#include "data.h"
+#include "error.h"
+
+/* The library works on sensors_this_context(): sensors_current_context,
+   set here for the duration of a call, or the published context. As it is
+   per thread, threads working on different contexts don't get in the way
+   of each other. */
+#define CTX_CALL(ctx, res, call) do { \
+	sensors_context *prev = sensors_current_context; \
+	sensors_current_context = (ctx); \
+	res = call; \
+	sensors_current_context = prev; \
+} while (0)
+
+/* Calls of sensors_context_acquire() which may be between loading
+   sensors_published_context and taking a reference on it, counted per
+   epoch. Publishing starts a new epoch, then waits only for the calls of
+   the previous one: calls starting meanwhile count in the new epoch and
+   can only get the new context. */
+static unsigned int sensors_epoch;
+static int sensors_acquiring[2];
+static pthread_mutex_t sensors_publish_lock = PTHREAD_MUTEX_INITIALIZER;
+
+sensors_context *sensors_context_new(void)
+{
+	sensors_context *ctx;
+
+	ctx = calloc(1, sizeof(sensors_context));
+	if (!ctx)
+		sensors_fatal_error(__func__, "Out of memory");
+	ctx->refs = 1;
+	return ctx;
+}
+
+void sensors_context_free(sensors_context *ctx)
+{
+	sensors_context_release(ctx);
+}
+
+sensors_context *sensors_context_acquire(void)
+{
+	sensors_context *ctx;
+	unsigned int epoch;
+
+	/* Count in the current epoch; if it ended before that was seen, the
+	   publisher may not wait for us, so try again in the next one */
+	for (;;) {
+		epoch = __atomic_load_n(&sensors_epoch, __ATOMIC_SEQ_CST) & 1;
+		__sync_fetch_and_add(&sensors_acquiring[epoch], 1);
+		if ((__atomic_load_n(&sensors_epoch, __ATOMIC_SEQ_CST) & 1) ==
+		    epoch)
+			break;
+		__sync_fetch_and_sub(&sensors_acquiring[epoch], 1);
+	}
+
+	ctx = __atomic_load_n(&sensors_published_context, __ATOMIC_SEQ_CST);
+	__sync_fetch_and_add(&ctx->refs, 1);
+	__sync_fetch_and_sub(&sensors_acquiring[epoch], 1);
+
+	return ctx;
+}
+
+void sensors_context_release(sensors_context *ctx)
+{
+	if (__sync_sub_and_fetch(&ctx->refs, 1))
+		return;
+
+	sensors_cleanup_ctx(ctx);
+	if (ctx != &sensors_default_context)
+		free(ctx);
+}
+
+void sensors_context_publish(sensors_context *ctx)
+{
+	sensors_context *old;
+	unsigned int epoch;
+
+	/* One publisher at a time, so that each epoch is waited for by the
+	   publisher which ended it */
+	pthread_mutex_lock(&sensors_publish_lock);
+
+	old = __atomic_exchange_n(&sensors_published_context, ctx,
+				  __ATOMIC_SEQ_CST);
+	epoch = __atomic_fetch_add(&sensors_epoch, 1, __ATOMIC_SEQ_CST) & 1;
+
+	/* Readers which got the old context may not have their reference
+	   yet; they all counted in the epoch which just ended. Readers
+	   which start now count in the new one, and may only be retried
+	   once, so this wait ends however busy the readers are. */
+	while (__atomic_load_n(&sensors_acquiring[epoch], __ATOMIC_SEQ_CST))
+		sched_yield();
+
+	pthread_mutex_unlock(&sensors_publish_lock);
+
+	sensors_context_release(old);
+}
+
+int sensors_init_ctx(sensors_context *ctx, FILE *input)
+{
+	int res;
+
+	CTX_CALL(ctx, res, sensors_init(input));
+	return res;
+}
+
+int sensors_init_filtered_ctx(sensors_context *ctx, FILE *input,
+			      const sensors_chip_name *match, int count)
+{
+	int res;
+
+	CTX_CALL(ctx, res, sensors_init_filtered(input, match, count));
+	return res;
+}
+
+void sensors_cleanup_ctx(sensors_context *ctx)
+{
+	sensors_context *prev = sensors_current_context;
+
+	sensors_current_context = ctx;
+	sensors_cleanup();
+	sensors_current_context = prev;
+}
+
+const char *sensors_get_adapter_name_ctx(sensors_context *ctx,
+					 const sensors_bus_id *bus)
+{
+	const char *res;
+
+	CTX_CALL(ctx, res, sensors_get_adapter_name(bus));
+	return res;
+}
+
+char *sensors_get_label_ctx(sensors_context *ctx,
+			    const sensors_chip_name *name,
+			    const sensors_feature *feature)
+{
+	char *res;
+
+	CTX_CALL(ctx, res, sensors_get_label(name, feature));
+	return res;
+}
+
+const char *sensors_get_label_const_ctx(sensors_context *ctx,
+					const sensors_chip_name *name,
+					const sensors_feature *feature)
+{
+	const char *res;
+
+	CTX_CALL(ctx, res, sensors_get_label_const(name, feature));
+	return res;
+}
+
+int sensors_get_value_ctx(sensors_context *ctx,
+			  const sensors_chip_name *name, int subfeat_nr,
+			  double *value)
+{
+	int res;
+
+	CTX_CALL(ctx, res, sensors_get_value(name, subfeat_nr, value));
+	return res;
+}
+
+int sensors_set_value_ctx(sensors_context *ctx,
+			  const sensors_chip_name *name, int subfeat_nr,
+			  double value)
+{
+	int res;
+
+	CTX_CALL(ctx, res, sensors_set_value(name, subfeat_nr, value));
+	return res;
+}
+
+int sensors_do_chip_sets_ctx(sensors_context *ctx,
+			     const sensors_chip_name *name)
+{
+	int res;
+
+	CTX_CALL(ctx, res, sensors_do_chip_sets(name));
+	return res;
+}
+
+int sensors_read_set_create_ctx(sensors_context *ctx, sensors_read_set **set,
+				const sensors_read_set_entry *entries,
+				int count)
+{
+	int res;
+
+	CTX_CALL(ctx, res, sensors_read_set_create(set, entries, count));
+	return res;
+}
+
+int sensors_read_set_create_all_ctx(sensors_context *ctx,
+				    sensors_read_set **set)
+{
+	int res;
+
+	CTX_CALL(ctx, res, sensors_read_set_create_all(set));
+	return res;
+}
+
+const sensors_chip_name *
+sensors_get_detected_chips_ctx(sensors_context *ctx,
+			       const sensors_chip_name *match, int *nr)
+{
+	const sensors_chip_name *res;
+
+	CTX_CALL(ctx, res, sensors_get_detected_chips(match, nr));
+	return res;
+}
+
+const sensors_feature *
+sensors_get_features_ctx(sensors_context *ctx,
+			 const sensors_chip_name *name, int *nr)
+{
+	const sensors_feature *res;
+
+	CTX_CALL(ctx, res, sensors_get_features(name, nr));
+	return res;
+}
+
+const sensors_subfeature *
+sensors_get_all_subfeatures_ctx(sensors_context *ctx,
+				const sensors_chip_name *name,
+				const sensors_feature *feature, int *nr)
+{
+	const sensors_subfeature *res;
+
+	CTX_CALL(ctx, res, sensors_get_all_subfeatures(name, feature, nr));
+	return res;
+}
+
+const sensors_subfeature *
+sensors_get_subfeature_ctx(sensors_context *ctx,
+			   const sensors_chip_name *name,
+			   const sensors_feature *feature,
+			   sensors_subfeature_type type)
+{
+	const sensors_subfeature *res;
+
+	CTX_CALL(ctx, res, sensors_get_subfeature(name, feature, type));
+	return res;
+}
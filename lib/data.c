@@ -28,31 +28,20 @@
 #include "access.h"
 #include "error.h"
 #include "data.h"
+#include "arena.h"
 #include "sensors.h"
 #include "../version.h"
 
 const char *libsensors_version = LM_VERSION;
 
-char **sensors_config_files = NULL;
-int sensors_config_files_count = 0;
-int sensors_config_files_max = 0;
+int sensors_opt_cache_fds = 0;
+int sensors_opt_init_threads = 0;
+char *sensors_cache_file = NULL;
 
-sensors_chip *sensors_config_chips = NULL;
-int sensors_config_chips_count = 0;
-int sensors_config_chips_subst = 0;
-int sensors_config_chips_max = 0;
-
-sensors_bus *sensors_config_busses = NULL;
-int sensors_config_busses_count = 0;
-int sensors_config_busses_max = 0;
-
-sensors_chip_features *sensors_proc_chips = NULL;
-int sensors_proc_chips_count = 0;
-int sensors_proc_chips_max = 0;
-
-sensors_bus *sensors_proc_bus = NULL;
-int sensors_proc_bus_count = 0;
-int sensors_proc_bus_max = 0;
+/* The reference of the publication */
+sensors_context sensors_default_context = { .refs = 1 };
+sensors_context *sensors_published_context = &sensors_default_context;
+__thread sensors_context *sensors_current_context;
 
 void sensors_free_chip_name(sensors_chip_name *chip)
 {
@@ -285,3 +274,69 @@ int sensors_substitute_busses(void)
 	sensors_config_chips_subst = sensors_config_chips_count;
 	return res;
 }
+
+/* FNV-1a hash of the chip prefix, combined with the bus and address */
+unsigned int sensors_hash_chip_name(const sensors_chip_name *name)
+{
+	const unsigned char *p;
+	unsigned int hash = 2166136261U;
+
+	for (p = (const unsigned char *)name->prefix; *p; p++)
+		hash = (hash ^ *p) * 16777619U;
+	hash = (hash ^ (unsigned short)name->bus.type) * 16777619U;
+	hash = (hash ^ (unsigned short)name->bus.nr) * 16777619U;
+	hash = (hash ^ (unsigned int)name->addr) * 16777619U;
+
+	return hash;
+}
+
+/* Build a hash table of the detected chips. We use open addressing with
+   linear probing, and insert the chips in order, so that a lookup finds
+   the same chip a linear scan of sensors_proc_chips would. */
+void sensors_index_proc_chips(void)
+{
+	int i, size;
+	unsigned int slot;
+
+	sensors_free_proc_chips_index();
+	if (!sensors_proc_chips_count)
+		return;
+
+	/* Keep the load factor at or below 1/2 */
+	for (size = 16; size < 2 * sensors_proc_chips_count; size *= 2)
+		;
+	sensors_proc_chips_index = malloc(size * sizeof(int));
+	if (!sensors_proc_chips_index)
+		sensors_fatal_error(__func__, "Out of memory");
+	sensors_proc_chips_index_size = size;
+	for (i = 0; i < size; i++)
+		sensors_proc_chips_index[i] = -1;
+
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		if (sensors_proc_chips[i]->removed)
+			continue;
+		slot = sensors_hash_chip_name(&sensors_proc_chips[i]->chip);
+		slot &= size - 1;
+		while (sensors_proc_chips_index[slot] >= 0)
+			slot = (slot + 1) & (size - 1);
+		sensors_proc_chips_index[slot] = i;
+	}
+}
+
+void sensors_free_proc_chips_index(void)
+{
+	free(sensors_proc_chips_index);
+	sensors_proc_chips_index = NULL;
+	sensors_proc_chips_index_size = 0;
+}
+
+void sensors_add_proc_chips(const sensors_chip_features *el)
+{
+	sensors_chip_features *chip;
+
+	chip = sensors_arena_alloc(sizeof(sensors_chip_features));
+	*chip = *el;
+	sensors_add_array_el(&chip, &sensors_proc_chips,
+			     &sensors_proc_chips_count, &sensors_proc_chips_max,
+			     sizeof(sensors_chip_features *));
+}
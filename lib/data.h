@@ -24,6 +24,7 @@
 
 #include "sensors.h"
 #include "general.h"
+#include "arena.h"
 
 /* This header file contains all kinds of data structures which are used
    for the representation of the config file data and the sensors
@@ -60,6 +61,42 @@ typedef struct sensors_expr {
 	} data;
 } sensors_expr;
 
+/* Instructions of compiled expressions. Programs run on a stack of values:
+   operations pop their operands and push their result. */
+typedef enum sensors_opcode {
+	sensors_op_val,		/* Push a constant */
+	sensors_op_source,	/* Push the raw value ('@') */
+	sensors_op_var,		/* Push the value of a variable */
+	sensors_op_add, sensors_op_sub, sensors_op_multiply, sensors_op_divide,
+	sensors_op_negate, sensors_op_exp, sensors_op_log,
+	/* Operations with a constant second operand */
+	sensors_op_add_val, sensors_op_sub_val, sensors_op_multiply_val,
+	sensors_op_divide_val,
+	sensors_op_madd,	/* Multiply, then add, with two constants */
+} sensors_opcode;
+
+typedef struct sensors_insn {
+	sensors_opcode op;
+	union {
+		double val;
+		int var;	/* Index in the variable table */
+		struct {
+			double mul;
+			double add;
+		} madd;
+	} data;
+} sensors_insn;
+
+/* An expression compiled to a flat program. The original expression tree
+   is kept along with it, for diagnostics. */
+typedef struct sensors_prog {
+	sensors_insn *code;
+	int code_count;
+	int stack_size;		/* Maximum depth of the stack */
+	const char **vars;	/* Variable names, point into the tree */
+	int vars_count;
+} sensors_prog;
+
 /* Config file line reference */
 typedef struct sensors_config_line {
 	const char *filename;
@@ -79,6 +116,7 @@ typedef struct sensors_label {
 typedef struct sensors_set {
 	char *name;
 	sensors_expr *value;
+	sensors_prog *prog;
 	sensors_config_line line;
 } sensors_set;
 
@@ -88,6 +126,8 @@ typedef struct sensors_compute {
 	char *name;
 	sensors_expr *from_proc;
 	sensors_expr *to_proc;
+	sensors_prog *from_prog;
+	sensors_prog *to_prog;
 	sensors_config_line line;
 } sensors_compute;
 
@@ -130,6 +170,26 @@ typedef struct sensors_bus {
 	sensors_config_line line;
 } sensors_bus;
 
+/* A compiled expression bound to a detected chip: its variables are
+   resolved to subfeature numbers of that chip, -1 if not found */
+typedef struct sensors_bound_prog {
+	const sensors_prog *prog;
+	int *vars;
+} sensors_bound_prog;
+
+/* A compute statement bound to a feature of a detected chip */
+typedef struct sensors_bound_compute {
+	sensors_bound_prog from_proc;
+	sensors_bound_prog to_proc;
+} sensors_bound_compute;
+
+/* A cached file descriptor which was dropped, but which other threads may
+   still be reading */
+typedef struct sensors_retired_fd {
+	struct sensors_retired_fd *next;
+	int fd;
+} sensors_retired_fd;
+
 /* Internal data about all features and subfeatures of a chip */
 typedef struct sensors_chip_features {
 	struct sensors_chip_name chip;
@@ -137,36 +197,135 @@ typedef struct sensors_chip_features {
 	struct sensors_subfeature *subfeature;
 	int feature_count;
 	int subfeature_count;
+	int *attr_fd;		/* Cached file descriptors, one per subfeature,
+				   -1 if not opened yet, -2 once dropped */
+	sensors_retired_fd **retired_fd; /* Dropped descriptors, only closed
+				   along with the chip */
+	char **label;		/* Interned labels, one per feature, NULL
+				   until looked up */
+	int loaded;		/* Features discovered and bound to the
+				   configuration, see sensors_load_chip() */
+	int removed;		/* Device gone, see sensors_hotplug_process() */
+	/* Subfeatures of each feature by type: slot_count slots per
+	   feature, each holding 1 + the subfeature offset from the first
+	   subfeature of the feature, or 0 if the feature has no subfeature
+	   of that type. See sensors_read_dynamic_chip() for the layout. */
+	unsigned short *subfeature_slot;
+	int slot_count;
+	/* Index of the first feature which is not ignored, for each feature
+	   and one past the last, so that ignored features can be skipped */
+	int *next_visible;
+	/* Compute statements bound to each feature, with NULL programs if
+	   none */
+	sensors_bound_compute *compute;
 } sensors_chip_features;
 
-extern char **sensors_config_files;
-extern int sensors_config_files_count;
-extern int sensors_config_files_max;
+/* Library options, see sensors_set_option() */
+extern int sensors_opt_cache_fds;
+extern int sensors_opt_init_threads;
+/* Path of the discovery cache file, NULL if none, see
+   sensors_set_cache_file() */
+extern char *sensors_cache_file;
+
+/* All the state of a library instance: the configuration and the detected
+   chips. The public functions work on sensors_this_context(), see
+   context.c. */
+struct sensors_context {
+	int refs;		/* See sensors_context_release() */
+
+	char **config_files;
+	int config_files_count;
+	int config_files_max;
+
+	sensors_chip *config_chips;
+	int config_chips_count;
+	int config_chips_subst;
+	int config_chips_max;
+
+	/* Only while parsing the configuration file */
+	sensors_bus *config_busses;
+	int config_busses_count;
+	int config_busses_max;
+
+	/* The detected chips are allocated one by one, so that they never
+	   move, even when chips are added by sensors_hotplug_process() */
+	sensors_chip_features **proc_chips;
+	int proc_chips_count;
+	int proc_chips_max;
+
+	/* Hash table of indexes into proc_chips, for the lookup of chip
+	   names without wildcards. Empty slots are set to -1. The size is a
+	   power of 2. */
+	int *proc_chips_index;
+	int proc_chips_index_size;
+
+	sensors_bus *proc_bus;
+	int proc_bus_count;
+	int proc_bus_max;
+
+	/* Everything discovered about the chips, see arena.c */
+	struct sensors_arena arena;
+};
+
+/* The context until another one is published */
+extern sensors_context sensors_default_context;
+/* The context used by the functions without _ctx(), see
+   sensors_context_publish() */
+extern sensors_context *sensors_published_context;
+/* The context given to the *_ctx() function being called in this thread,
+   NULL if none */
+extern __thread sensors_context *sensors_current_context;
+
+#define sensors_this_context() \
+	(sensors_current_context ? sensors_current_context : \
+	 __atomic_load_n(&sensors_published_context, __ATOMIC_SEQ_CST))
+
+#define sensors_config_files	(sensors_this_context()->config_files)
+#define sensors_config_files_count \
+	(sensors_this_context()->config_files_count)
+#define sensors_config_files_max \
+	(sensors_this_context()->config_files_max)
 
 #define sensors_add_config_files(el) sensors_add_array_el( \
 	(el), &sensors_config_files, &sensors_config_files_count, \
 	&sensors_config_files_max, sizeof(char *))
 
-extern sensors_chip *sensors_config_chips;
-extern int sensors_config_chips_count;
-extern int sensors_config_chips_subst;
-extern int sensors_config_chips_max;
-
-extern sensors_bus *sensors_config_busses;
-extern int sensors_config_busses_count;
-extern int sensors_config_busses_max;
-
-extern sensors_chip_features *sensors_proc_chips;
-extern int sensors_proc_chips_count;
-extern int sensors_proc_chips_max;
-
-#define sensors_add_proc_chips(el) sensors_add_array_el( \
-	(el), &sensors_proc_chips, &sensors_proc_chips_count,\
-	&sensors_proc_chips_max, sizeof(struct sensors_chip_features))
-
-extern sensors_bus *sensors_proc_bus;
-extern int sensors_proc_bus_count;
-extern int sensors_proc_bus_max;
+#define sensors_config_chips	(sensors_this_context()->config_chips)
+#define sensors_config_chips_count \
+	(sensors_this_context()->config_chips_count)
+#define sensors_config_chips_subst \
+	(sensors_this_context()->config_chips_subst)
+#define sensors_config_chips_max \
+	(sensors_this_context()->config_chips_max)
+
+#define sensors_config_busses	(sensors_this_context()->config_busses)
+#define sensors_config_busses_count \
+	(sensors_this_context()->config_busses_count)
+#define sensors_config_busses_max \
+	(sensors_this_context()->config_busses_max)
+
+#define sensors_proc_chips	(sensors_this_context()->proc_chips)
+#define sensors_proc_chips_count \
+	(sensors_this_context()->proc_chips_count)
+#define sensors_proc_chips_max	(sensors_this_context()->proc_chips_max)
+
+/* Add a copy of el to sensors_proc_chips */
+void sensors_add_proc_chips(const sensors_chip_features *el);
+
+#define sensors_proc_chips_index \
+	(sensors_this_context()->proc_chips_index)
+#define sensors_proc_chips_index_size \
+	(sensors_this_context()->proc_chips_index_size)
+
+unsigned int sensors_hash_chip_name(const sensors_chip_name *name);
+
+/* (Re)build the index, once sensors_proc_chips is complete */
+void sensors_index_proc_chips(void);
+void sensors_free_proc_chips_index(void);
+
+#define sensors_proc_bus	(sensors_this_context()->proc_bus)
+#define sensors_proc_bus_count	(sensors_this_context()->proc_bus_count)
+#define sensors_proc_bus_max	(sensors_this_context()->proc_bus_max)
 
 #define sensors_add_proc_bus(el) sensors_add_array_el( \
 	(el), &sensors_proc_bus, &sensors_proc_bus_count,\
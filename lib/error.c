@@ -37,6 +37,7 @@ static const char *errorlist[] = {
 	/* SENSORS_ERR_ACCESS_W  */ "Can't write",
 	/* SENSORS_ERR_IO        */ "I/O error",
 	/* SENSORS_ERR_RECURSION */ "Evaluation recurses too deep",
+	/* SENSORS_ERR_BUSY      */ "Context in use",
 };
 
 const char *sensors_strerror(int errnum)
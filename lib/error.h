@@ -33,6 +33,7 @@
 #define SENSORS_ERR_ACCESS_W	9 /* Can't write */
 #define SENSORS_ERR_IO		10 /* I/O error */
 #define SENSORS_ERR_RECURSION	11 /* Evaluation recurses too deep */
+#define SENSORS_ERR_BUSY	12 /* Context in use */
 
 #ifdef __cplusplus
 extern "C" {
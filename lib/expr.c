@@ -0,0 +1,369 @@
+/*
+    expr.c - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "expr.h"
+#include "data.h"
+#include "error.h"
+
+/* Programs which need a deeper stack than this get it from the heap.
+   None of the configuration files we ship come anywhere close. */
+#define STACK_MAX	32
+
+static const sensors_opcode expr_opcode[] = {
+	[sensors_add]		= sensors_op_add,
+	[sensors_sub]		= sensors_op_sub,
+	[sensors_multiply]	= sensors_op_multiply,
+	[sensors_divide]	= sensors_op_divide,
+	[sensors_negate]	= sensors_op_negate,
+	[sensors_exp]		= sensors_op_exp,
+	[sensors_log]		= sensors_op_log,
+};
+
+/* Evaluate a constant expression at compile time. Returns 1 and stores
+   its value in *val if the expression depends neither on the raw value nor
+   on variables, and evaluates without error. Returns 0 otherwise, in which
+   case the expression is left for run time, errors included. The operations
+   are the same as sensors_run_prog() would do, so the result is exactly
+   the same. */
+static int expr_fold(const sensors_expr *expr, double *val)
+{
+	double val1, val2 = 0.0;
+
+	switch (expr->kind) {
+	case sensors_kind_val:
+		*val = expr->data.val;
+		return 1;
+	case sensors_kind_source:
+	case sensors_kind_var:
+		return 0;
+	case sensors_kind_sub:
+		break;
+	}
+
+	if (!expr_fold(expr->data.subexpr.sub1, &val1) ||
+	    (expr->data.subexpr.sub2 &&
+	     !expr_fold(expr->data.subexpr.sub2, &val2)))
+		return 0;
+
+	switch (expr->data.subexpr.op) {
+	case sensors_add:
+		*val = val1 + val2;
+		return 1;
+	case sensors_sub:
+		*val = val1 - val2;
+		return 1;
+	case sensors_multiply:
+		*val = val1 * val2;
+		return 1;
+	case sensors_divide:
+		if (val2 == 0.0)
+			return 0;
+		*val = val1 / val2;
+		return 1;
+	case sensors_negate:
+		*val = -val1;
+		return 1;
+	case sensors_exp:
+		*val = exp(val1);
+		return 1;
+	case sensors_log:
+		if (val1 < 0.0)
+			return 0;
+		*val = log(val1);
+		return 1;
+	}
+	return 0;
+}
+
+/* Count the nodes of an expression tree, which is also the maximum
+   number of instructions and variables of the program */
+static int expr_count_nodes(const sensors_expr *expr)
+{
+	int count = 1;
+
+	if (expr->kind == sensors_kind_sub) {
+		count += expr_count_nodes(expr->data.subexpr.sub1);
+		if (expr->data.subexpr.sub2)
+			count += expr_count_nodes(expr->data.subexpr.sub2);
+	}
+	return count;
+}
+
+/* Return the index of a variable in the variable table, adding it if
+   needed */
+static int prog_add_var(sensors_prog *prog, const char *name)
+{
+	int i;
+
+	for (i = 0; i < prog->vars_count; i++)
+		if (!strcmp(prog->vars[i], name))
+			return i;
+	prog->vars[prog->vars_count] = name;
+	return prog->vars_count++;
+}
+
+static void prog_emit(sensors_prog *prog, const sensors_insn *insn)
+{
+	prog->code[prog->code_count++] = *insn;
+}
+
+/* Emit an operation with a constant second operand, to be applied to the
+   value computed by the instructions emitted last. Operations which
+   never change the value are dropped, and a multiplication followed by an
+   addition or subtraction is merged into a single instruction. All of this
+   only holds if the value is not a signaling NaN, which strtod() never
+   returns. */
+static void prog_emit_val_op(sensors_prog *prog, sensors_operation op,
+			     double val)
+{
+	sensors_insn insn, *last;
+
+	switch (op) {
+	case sensors_add:
+		/* x + 0 is not x if x is -0, but x + -0 always is */
+		if (val == 0.0 && signbit(val))
+			return;
+		insn.op = sensors_op_add_val;
+		break;
+	case sensors_sub:
+		if (val == 0.0 && !signbit(val))
+			return;
+		insn.op = sensors_op_sub_val;
+		break;
+	case sensors_multiply:
+		if (val == 1.0)
+			return;
+		insn.op = sensors_op_multiply_val;
+		break;
+	case sensors_divide:
+		if (val == 1.0)
+			return;
+		insn.op = sensors_op_divide_val;
+		break;
+	default:
+		return;	/* Not reached */
+	}
+	insn.data.val = val;
+
+	/* x - y is defined as x + (-y), except for NaN payloads */
+	last = &prog->code[prog->code_count - 1];
+	if (last->op == sensors_op_multiply_val &&
+	    (insn.op == sensors_op_add_val ||
+	     (insn.op == sensors_op_sub_val && !isnan(val)))) {
+		last->op = sensors_op_madd;
+		last->data.madd.mul = last->data.val;
+		last->data.madd.add = insn.op == sensors_op_add_val ? val : -val;
+		return;
+	}
+
+	prog_emit(prog, &insn);
+}
+
+/* Emit the instructions of an expression, in postfix order. depth is the
+   depth of the stack before the instructions run. Constant subexpressions
+   are folded. */
+static void prog_emit_expr(sensors_prog *prog, const sensors_expr *expr,
+			   int depth)
+{
+	const sensors_expr *sub1, *sub2;
+	sensors_operation op;
+	sensors_insn insn;
+	double val;
+
+	switch (expr->kind) {
+	case sensors_kind_val:
+		insn.op = sensors_op_val;
+		insn.data.val = expr->data.val;
+		break;
+	case sensors_kind_source:
+		insn.op = sensors_op_source;
+		break;
+	case sensors_kind_var:
+		insn.op = sensors_op_var;
+		insn.data.var = prog_add_var(prog, expr->data.var);
+		break;
+	case sensors_kind_sub:
+		if (expr_fold(expr, &val)) {
+			insn.op = sensors_op_val;
+			insn.data.val = val;
+			break;
+		}
+
+		sub1 = expr->data.subexpr.sub1;
+		sub2 = expr->data.subexpr.sub2;
+		op = expr->data.subexpr.op;
+
+		/* Constant second operand. Division by zero is left for
+		   run time, to report the error. */
+		if (sub2 && expr_fold(sub2, &val) &&
+		    !(op == sensors_divide && val == 0.0)) {
+			prog_emit_expr(prog, sub1, depth);
+			prog_emit_val_op(prog, op, val);
+			return;
+		}
+
+		/* Constant first operand of a commutative operation. The
+		   constant can't fail, so the order of evaluation doesn't
+		   matter. */
+		if ((op == sensors_add || op == sensors_multiply) &&
+		    expr_fold(sub1, &val) && !isnan(val)) {
+			prog_emit_expr(prog, sub2, depth);
+			prog_emit_val_op(prog, op, val);
+			return;
+		}
+
+		prog_emit_expr(prog, sub1, depth);
+		if (sub2)
+			prog_emit_expr(prog, sub2, depth + 1);
+		insn.op = expr_opcode[op];
+		prog_emit(prog, &insn);
+		return;
+	}
+
+	/* Leaves push one value */
+	if (depth + 1 > prog->stack_size)
+		prog->stack_size = depth + 1;
+	prog_emit(prog, &insn);
+}
+
+sensors_prog *sensors_compile_expr(const sensors_expr *expr)
+{
+	sensors_prog *prog;
+	int count;
+
+	count = expr_count_nodes(expr);
+	prog = malloc(sizeof(sensors_prog));
+	if (!prog)
+		sensors_fatal_error(__func__, "Out of memory");
+	prog->code = malloc(count * sizeof(sensors_insn));
+	prog->vars = malloc(count * sizeof(char *));
+	if (!prog->code || !prog->vars)
+		sensors_fatal_error(__func__, "Out of memory");
+	prog->code_count = 0;
+	prog->stack_size = 0;
+	prog->vars_count = 0;
+
+	prog_emit_expr(prog, expr, 0);
+
+	return prog;
+}
+
+void sensors_free_prog(sensors_prog *prog)
+{
+	if (!prog)
+		return;
+	free(prog->code);
+	free(prog->vars);
+	free(prog);
+}
+
+int sensors_run_prog(const sensors_prog *prog, double val,
+		     sensors_get_var_func get_var, const void *data,
+		     double *result)
+{
+	double stack_buf[STACK_MAX], *stack, *sp;
+	const sensors_insn *insn, *end;
+	int res = 0;
+
+	if (prog->stack_size <= STACK_MAX) {
+		stack = stack_buf;
+	} else {
+		stack = malloc(prog->stack_size * sizeof(double));
+		if (!stack)
+			sensors_fatal_error(__func__, "Out of memory");
+	}
+
+	/* sp points to the first free slot */
+	sp = stack;
+	end = prog->code + prog->code_count;
+	for (insn = prog->code; insn < end; insn++) {
+		switch (insn->op) {
+		case sensors_op_val:
+			*sp++ = insn->data.val;
+			break;
+		case sensors_op_source:
+			*sp++ = val;
+			break;
+		case sensors_op_var:
+			if ((res = get_var(data, insn->data.var, sp)))
+				goto exit;
+			sp++;
+			break;
+		case sensors_op_add:
+			sp--;
+			sp[-1] += sp[0];
+			break;
+		case sensors_op_sub:
+			sp--;
+			sp[-1] -= sp[0];
+			break;
+		case sensors_op_multiply:
+			sp--;
+			sp[-1] *= sp[0];
+			break;
+		case sensors_op_divide:
+			sp--;
+			if (sp[0] == 0.0) {
+				res = -SENSORS_ERR_DIV_ZERO;
+				goto exit;
+			}
+			sp[-1] /= sp[0];
+			break;
+		case sensors_op_negate:
+			sp[-1] = -sp[-1];
+			break;
+		case sensors_op_exp:
+			sp[-1] = exp(sp[-1]);
+			break;
+		case sensors_op_log:
+			if (sp[-1] < 0.0) {
+				res = -SENSORS_ERR_DIV_ZERO;
+				goto exit;
+			}
+			sp[-1] = log(sp[-1]);
+			break;
+		case sensors_op_add_val:
+			sp[-1] += insn->data.val;
+			break;
+		case sensors_op_sub_val:
+			sp[-1] -= insn->data.val;
+			break;
+		case sensors_op_multiply_val:
+			sp[-1] *= insn->data.val;
+			break;
+		case sensors_op_divide_val:
+			sp[-1] /= insn->data.val;	/* Never 0 */
+			break;
+		case sensors_op_madd:
+			/* Not fused, see Module.mk */
+			sp[-1] = sp[-1] * insn->data.madd.mul +
+				 insn->data.madd.add;
+			break;
+		}
+	}
+	*result = stack[0];
+
+exit:
+	if (stack != stack_buf)
+		free(stack);
+	return res;
+}
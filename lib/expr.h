@@ -0,0 +1,43 @@
+/*
+    expr.h - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#ifndef LIB_SENSORS_EXPR_H
+#define LIB_SENSORS_EXPR_H
+
+#include "data.h"
+
+/* Compile an expression tree to a program. The tree must not be freed
+   before the program. */
+sensors_prog *sensors_compile_expr(const sensors_expr *expr);
+
+void sensors_free_prog(sensors_prog *prog);
+
+/* Called by sensors_run_prog() to get the value of variable var of the
+   program. Returns 0 on success, <0 on failure. */
+typedef int (*sensors_get_var_func)(const void *data, int var,
+				    double *value);
+
+/* Run a program, with val as the raw value ('@'). Variables are evaluated
+   in the order in which the original expression referenced them. This
+   function will return 0 on success, and <0 on failure. */
+int sensors_run_prog(const sensors_prog *prog, double val,
+		     sensors_get_var_func get_var, const void *data,
+		     double *result);
+
+#endif /* def LIB_SENSORS_EXPR_H */
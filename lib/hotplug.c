@@ -0,0 +1,333 @@
+/*
+    hotplug.c - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "sensors.h"
+#include "data.h"
+#include "error.h"
+#include "sysfs.h"
+#include "access.h"
+#include "hotplug.h"
+
+/* Large enough for any uevent, the kernel limits them to 2 kB */
+#define UEVENT_BUFFER_SIZE	8192
+/* Room for bursts of events, e.g. when a PMBus shelf comes up */
+#define UEVENT_RCVBUF_SIZE	(256 * 1024)
+
+static int hotplug_fd = -1;
+
+int sensors_hotplug_open(void)
+{
+	struct sockaddr_nl addr;
+	int fd, size = UEVENT_RCVBUF_SIZE;
+
+	if (hotplug_fd >= 0)
+		return hotplug_fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -SENSORS_ERR_KERNEL;
+
+	/* Not fatal, we resynchronize if events get lost */
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;	/* Events from the kernel, not from udev */
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -SENSORS_ERR_KERNEL;
+	}
+
+	hotplug_fd = fd;
+	return fd;
+}
+
+void sensors_hotplug_close(void)
+{
+	if (hotplug_fd >= 0) {
+		close(hotplug_fd);
+		hotplug_fd = -1;
+	}
+}
+
+/* The chip stays in sensors_proc_chips, so that pointers to it remain
+   valid, but it can no longer be found. No other thread uses the library
+   meanwhile, so its files can be closed. */
+static void hotplug_remove_chip(sensors_chip_features *chip)
+{
+	chip->removed = 1;
+	sensors_close_attr_fds(chip);
+}
+
+/* Returns the detected chip with the given path, NULL if none */
+static sensors_chip_features *hotplug_find_chip(const char *path)
+{
+	int i;
+
+	for (i = 0; i < sensors_proc_chips_count; i++)
+		if (!sensors_proc_chips[i]->removed &&
+		    !strcmp(sensors_proc_chips[i]->chip.path, path))
+			return sensors_proc_chips[i];
+	return NULL;
+}
+
+/* Returns the removed chip with the same path and name as entry, NULL if
+   none */
+static sensors_chip_features *
+hotplug_find_removed(const sensors_chip_features *entry)
+{
+	sensors_chip_features *chip;
+	int i;
+
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		chip = sensors_proc_chips[i];
+		if (chip->removed &&
+		    !strcmp(chip->chip.path, entry->chip.path) &&
+		    !strcmp(chip->chip.prefix, entry->chip.prefix) &&
+		    chip->chip.bus.type == entry->chip.bus.type &&
+		    chip->chip.bus.nr == entry->chip.bus.nr &&
+		    chip->chip.addr == entry->chip.addr)
+			return chip;
+	}
+	return NULL;
+}
+
+/* Give a removed chip to the device which came back at its path. It may
+   not be the same model, e.g. a PSU swapped behind the same driver and
+   address, so everything known about its features is dropped and
+   discovered again when first needed. The previous tables stay in the
+   arena, for callers still holding features of the removed chip. */
+static void hotplug_revive_chip(sensors_chip_features *chip,
+				const sensors_chip_features *entry)
+{
+	sensors_close_attr_fds(chip);
+	sensors_unbind_config(chip);
+	/* The name is the same, and its strings are interned */
+	*chip = *entry;
+}
+
+/* Returns 1 if a chip was added, 0 if not, <0 on error */
+static int hotplug_add(const char *class_path)
+{
+	sensors_chip_features entry, *chip;
+	int err;
+
+	/* Already known, e.g. after a rescan */
+	if (hotplug_find_chip(class_path))
+		return 0;
+
+	err = sensors_read_sysfs_chip(class_path, &entry);
+	if (err < 0)
+		return err;
+	if (!entry.chip.prefix)
+		return 0;
+
+	/* The attributes may be those of the device itself */
+	if (hotplug_find_chip(entry.chip.path))
+		return 0;
+
+	/* A device which comes back gets its entry back, so that devices
+	   which come and go don't make the list grow */
+	if ((chip = hotplug_find_removed(&entry))) {
+		hotplug_revive_chip(chip, &entry);
+		return 1;
+	}
+
+	sensors_add_proc_chips(&entry);
+	return 1;
+}
+
+/* Returns the number of chips removed. dev_path is the path of the parent
+   device, if known, for chips using its attributes. */
+static int hotplug_remove(const char *class_path, const char *dev_path)
+{
+	sensors_chip_features *chip;
+	int count = 0;
+
+	if ((chip = hotplug_find_chip(class_path))) {
+		hotplug_remove_chip(chip);
+		count++;
+	}
+	if (dev_path && (chip = hotplug_find_chip(dev_path))) {
+		hotplug_remove_chip(chip);
+		count++;
+	}
+	return count;
+}
+
+int sensors_hotplug_apply(const char *msg, size_t len)
+{
+	const char *p, *end = msg + len, *name;
+	const char *action = NULL, *devpath = NULL, *subsystem = NULL;
+	char class_path[PATH_MAX], dev_path[PATH_MAX];
+	int res, dev_len;
+
+	/* Skip the "ACTION@DEVPATH" header, everything is in the keys */
+	if (!len || msg[len - 1] != '\0' || !strchr(msg, '@'))
+		return 0;
+	for (p = msg + strlen(msg) + 1; p < end; p += strlen(p) + 1) {
+		if (!strncmp(p, "ACTION=", 7))
+			action = p + 7;
+		else if (!strncmp(p, "DEVPATH=", 8))
+			devpath = p + 8;
+		else if (!strncmp(p, "SUBSYSTEM=", 10))
+			subsystem = p + 10;
+	}
+	if (!action || !devpath || !subsystem || strcmp(subsystem, "hwmon"))
+		return 0;
+
+	/* We know hwmon class devices by their class path */
+	name = strrchr(devpath, '/');
+	if (!name || !name[1] || name[1] == '.')
+		return 0;
+	/* Paths which don't fit can't be those of known chips */
+	if (snprintf(class_path, PATH_MAX, "%s/class/hwmon/%s",
+		     sensors_sysfs_mount, name + 1) >= PATH_MAX)
+		return 0;
+
+	if (!strcmp(action, "add")) {
+		res = hotplug_add(class_path);
+	} else if (!strcmp(action, "remove")) {
+		/* The parent device, if the class device is in its "hwmon"
+		   subdirectory */
+		dev_len = name - devpath - 6;
+		if (dev_len > 0 && !strncmp(devpath + dev_len, "/hwmon", 6)) {
+			if (snprintf(dev_path, PATH_MAX, "%s%.*s",
+				     sensors_sysfs_mount, dev_len,
+				     devpath) >= PATH_MAX)
+				return 0;
+		} else {
+			dev_path[0] = '\0';
+		}
+		res = hotplug_remove(class_path,
+				     dev_path[0] ? dev_path : NULL);
+	} else {
+		return 0;
+	}
+
+	if (res > 0)
+		sensors_index_proc_chips();
+	return res;
+}
+
+/* Bring the list of chips up to date after events were lost. Returns the
+   number of chips added or removed. */
+static int hotplug_rescan(void)
+{
+	char path[PATH_MAX];
+	struct dirent *ent;
+	DIR *dir;
+	int i, res, count = 0;
+
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		if (sensors_proc_chips[i]->removed ||
+		    !access(sensors_proc_chips[i]->chip.path, F_OK) ||
+		    errno != ENOENT)
+			continue;
+		hotplug_remove_chip(sensors_proc_chips[i]);
+		count++;
+	}
+
+	snprintf(path, PATH_MAX, "%s/class/hwmon", sensors_sysfs_mount);
+	if ((dir = opendir(path))) {
+		while ((ent = readdir(dir))) {
+			if (ent->d_name[0] == '.')	/* skip hidden entries */
+				continue;
+			if (snprintf(path, PATH_MAX, "%s/class/hwmon/%s",
+				     sensors_sysfs_mount,
+				     ent->d_name) >= PATH_MAX)
+				continue;
+			res = hotplug_add(path);
+			if (res > 0)
+				count += res;
+		}
+		closedir(dir);
+	}
+
+	if (count)
+		sensors_index_proc_chips();
+	return count;
+}
+
+int sensors_hotplug_process(void)
+{
+	char buf[UEVENT_BUFFER_SIZE];
+	struct sockaddr_nl addr;
+	struct iovec iov;
+	struct msghdr msg;
+	sensors_context *ctx;
+	ssize_t len;
+	int res, changes = 0;
+
+	if (hotplug_fd < 0)
+		return -SENSORS_ERR_KERNEL;
+
+	/* The published context is changed in place, which its readers
+	   with a reference, such as samplers, can't cope with. Only the
+	   publication may hold one. The events are left pending. */
+	ctx = __atomic_load_n(&sensors_published_context, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ctx->refs, __ATOMIC_SEQ_CST) > 1)
+		return -SENSORS_ERR_BUSY;
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		iov.iov_base = buf;
+		iov.iov_len = sizeof(buf);
+		msg.msg_name = &addr;
+		msg.msg_namelen = sizeof(addr);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+
+		len = recvmsg(hotplug_fd, &msg, MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == ENOBUFS) {
+				/* The socket overflowed, events were lost */
+				changes += hotplug_rescan();
+				continue;
+			}
+			return -SENSORS_ERR_KERNEL;
+		}
+
+		/* Only the kernel is trusted, not other processes */
+		if (addr.nl_pid || (msg.msg_flags & MSG_TRUNC))
+			continue;
+
+		/* Errors are not fatal, the device may already be gone */
+		res = sensors_hotplug_apply(buf, len);
+		if (res > 0)
+			changes += res;
+	}
+
+	return changes;
+}
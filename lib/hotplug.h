@@ -0,0 +1,33 @@
+/*
+    hotplug.h - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#ifndef LIB_SENSORS_HOTPLUG_H
+#define LIB_SENSORS_HOTPLUG_H
+
+#include <stddef.h>
+
+/* Apply a uevent message, as sent by the kernel: "ACTION@DEVPATH" followed
+   by "KEY=value" strings, all NUL-terminated. Chips are added or removed
+   on add and remove events of hwmon class devices, other messages are
+   ignored. The current context is changed in place: no other thread may
+   use it meanwhile. Returns the number of chips added or removed, or <0
+   on error. */
+int sensors_hotplug_apply(const char *msg, size_t len);
+
+#endif /* def LIB_SENSORS_HOTPLUG_H */
@@ -32,6 +32,7 @@
 #include <errno.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <pthread.h>
 #include "sensors.h"
 #include "data.h"
 #include "error.h"
@@ -40,35 +41,35 @@
 #include "sysfs.h"
 #include "scanner.h"
 #include "init.h"
+#include "expr.h"
+#include "cache.h"
+#include "arena.h"
 
 #define DEFAULT_CONFIG_FILE	ETCDIR "/sensors3.conf"
 #define ALT_CONFIG_FILE		ETCDIR "/sensors.conf"
 #define DEFAULT_CONFIG_DIR	ETCDIR "/sensors.d"
 
+/* The configuration file parser and the chip filter are global, so
+   contexts are initialized one at a time */
+static pthread_mutex_t sensors_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* Wrapper around sensors_yyparse(), which clears the locale so that
-   the decimal numbers are always parsed properly. */
+   the decimal numbers are always parsed properly. Only the locale of the
+   calling thread is changed, other threads are not affected. */
 static int sensors_parse(void)
 {
 	int res;
-	char *locale;
-
-	/* Remember the current locale and clear it */
-	locale = setlocale(LC_ALL, NULL);
-	if (locale) {
-		locale = strdup(locale);
-		if (!locale)
-			sensors_fatal_error(__func__, "Out of memory");
+	locale_t c_locale, old_locale;
 
-		setlocale(LC_ALL, "C");
-	}
+	c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+	if (!c_locale)
+		sensors_fatal_error(__func__, "Out of memory");
+	old_locale = uselocale(c_locale);
 
 	res = sensors_yyparse();
 
-	/* Restore the old locale */
-	if (locale) {
-		setlocale(LC_ALL, locale);
-		free(locale);
-	}
+	uselocale(old_locale);
+	freelocale(c_locale);
 
 	return res;
 }
@@ -176,16 +177,85 @@ static int add_config_from_dir(const char *dir)
 	return res;
 }
 
-/* Ideally, initialization and configuraton file loading should be exposed
-   separately, to make it possible to load several configuration files. */
-int sensors_init(FILE *input)
+int sensors_set_option(int option, int value)
 {
-	int res;
+	switch (option) {
+	case SENSORS_OPT_CACHE_FDS:
+		sensors_opt_cache_fds = !!value;
+		return 0;
+	case SENSORS_OPT_INIT_THREADS:
+		sensors_opt_init_threads = value > 1 ? value : 0;
+		return 0;
+	}
+	return -SENSORS_ERR_NO_ENTRY;
+}
+
+int sensors_set_cache_file(const char *path)
+{
+	char *file = NULL;
+
+	if (path && !(file = strdup(path)))
+		sensors_fatal_error(__func__, "Out of memory");
+	free(sensors_cache_file);
+	sensors_cache_file = file;
+	return 0;
+}
+
+static void free_chip(sensors_chip *chip);
+
+/* Returns 1 if a chip statement names a chip matching the filter */
+static int config_chip_matches(const sensors_chip *chip,
+			       const sensors_chip_name *match, int count)
+{
+	int i, j;
+
+	for (i = 0; i < chip->chips.fits_count; i++)
+		for (j = 0; j < count; j++)
+			if (sensors_match_chip(&chip->chips.fits[i], &match[j]))
+				return 1;
+	return 0;
+}
+
+/* Drop the chip statements of the configuration file which can't apply to
+   any chip matching the filter. If a detected chip matches both a filter
+   name and a chip statement name, these two names match each other. */
+static void filter_config_chips(const sensors_chip_name *match, int count)
+{
+	sensors_chip *chip;
+	int i, j;
+
+	for (i = 0, j = 0; i < sensors_config_chips_count; i++) {
+		chip = &sensors_config_chips[i];
+		if (config_chip_matches(chip, match, count))
+			sensors_config_chips[j++] = *chip;
+		else
+			free_chip(chip);
+	}
+	sensors_config_chips_count = j;
+}
+
+static int init_filtered(FILE *input, const sensors_chip_name *match,
+			 int count)
+{
+	sensors_topology topo;
+	int res, i, cached = 0, save = 0;
 
 	if (!sensors_init_sysfs())
 		return -SENSORS_ERR_KERNEL;
-	if ((res = sensors_read_sysfs_bus()) ||
-	    (res = sensors_read_sysfs_chips()))
+
+	/* The topology is taken before the chips are discovered, so that
+	   the cache is never newer than it claims */
+	if (sensors_cache_file && !sensors_scan_topology(&topo)) {
+		cached = !sensors_read_cache(sensors_cache_file, &topo,
+					     match, count);
+		/* A filtered discovery isn't complete */
+		save = !cached && !match;
+		if (!save)
+			sensors_free_topology(&topo);
+	}
+	if (!cached &&
+	    ((res = sensors_read_sysfs_bus()) ||
+	     (res = sensors_read_sysfs_chips(match, count))))
 		goto exit_cleanup;
 
 	if (input) {
@@ -217,29 +287,60 @@ int sensors_init(FILE *input)
 			goto exit_cleanup;
 	}
 
+	if (match)
+		filter_config_chips(match, count);
+	sensors_bind_config();
+
+	if (save) {
+		/* A chip which can't be loaded would be cached without
+		   features */
+		for (i = 0; i < sensors_proc_chips_count; i++)
+			if (!sensors_load_chip(sensors_proc_chips[i]))
+				break;
+		if (i == sensors_proc_chips_count)
+			sensors_write_cache(sensors_cache_file, &topo);
+		sensors_free_topology(&topo);
+	}
+
 	return 0;
 
 exit_cleanup:
+	if (save)
+		sensors_free_topology(&topo);
 	sensors_cleanup();
 	return res;
 }
 
+int sensors_init_filtered(FILE *input, const sensors_chip_name *match,
+			  int count)
+{
+	int res;
+
+	pthread_mutex_lock(&sensors_init_lock);
+	res = init_filtered(input, match, count);
+	pthread_mutex_unlock(&sensors_init_lock);
+
+	return res;
+}
+
+/* Ideally, initialization and configuraton file loading should be exposed
+   separately, to make it possible to load several configuration files. */
+int sensors_init(FILE *input)
+{
+	return sensors_init_filtered(input, NULL, 0);
+}
+
 static void free_chip_name(sensors_chip_name *name)
 {
 	free(name->prefix);
 	free(name->path);
 }
 
+/* Everything else is in the arena */
 static void free_chip_features(sensors_chip_features *features)
 {
-	int i;
-
-	for (i = 0; i < features->subfeature_count; i++)
-		free(features->subfeature[i].name);
-	free(features->subfeature);
-	for (i = 0; i < features->feature_count; i++)
-		free(features->feature[i].name);
-	free(features->feature);
+	sensors_close_attr_fds(features);
+	sensors_unbind_config(features);
 }
 
 static void free_label(sensors_label *label)
@@ -265,6 +366,7 @@ static void free_set(sensors_set *set)
 {
 	free(set->name);
 	sensors_free_expr(set->value);
+	sensors_free_prog(set->prog);
 }
 
 static void free_compute(sensors_compute *compute)
@@ -272,6 +374,8 @@ static void free_compute(sensors_compute *compute)
 	free(compute->name);
 	sensors_free_expr(compute->from_proc);
 	sensors_free_expr(compute->to_proc);
+	sensors_free_prog(compute->from_prog);
+	sensors_free_prog(compute->to_prog);
 }
 
 static void free_ignore(sensors_ignore *ignore)
@@ -313,13 +417,13 @@ void sensors_cleanup(void)
 {
 	int i;
 
-	for (i = 0; i < sensors_proc_chips_count; i++) {
-		free_chip_name(&sensors_proc_chips[i].chip);
-		free_chip_features(&sensors_proc_chips[i]);
-	}
+	for (i = 0; i < sensors_proc_chips_count; i++)
+		free_chip_features(sensors_proc_chips[i]);
+	sensors_arena_free();
 	free(sensors_proc_chips);
 	sensors_proc_chips = NULL;
 	sensors_proc_chips_count = sensors_proc_chips_max = 0;
+	sensors_free_proc_chips_index();
 
 	for (i = 0; i < sensors_config_chips_count; i++)
 		free_chip(&sensors_config_chips[i]);
@@ -0,0 +1,456 @@
+/*
+    sampler.c - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * A sampler thread reads subfeatures on schedule into one ring per
+ * subfeature. Subfeatures with the same period are read together, as a
+ * read set, so they get the same compute statements as with
+ * sensors_get_value(). The thread sleeps on a timerfd until the next group
+ * is due, and on an eventfd which tells it to stop.
+ *
+ * The sampler thread is the only writer of the rings, any number of
+ * threads read them. Each ring is protected by a sequence counter, odd
+ * while a sample is being written: readers copy what they need, and try
+ * again if the counter changed meanwhile. Readers thus never block the
+ * sampler thread, nor make system calls.
+ *
+ * Values can also be pushed to a stream, of which the sampler thread then
+ * is the producer.
+ */
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sensors.h"
+#include "error.h"
+#include "access.h"
+
+#define NSEC_PER_MSEC	1000000ULL
+#define NSEC_PER_SEC	1000000000ULL
+
+struct sampler_slot {
+	unsigned long long time;	/* CLOCK_MONOTONIC, in ns */
+	double value;
+};
+
+struct sampler_ring {
+	unsigned int seq;		/* Odd while a sample is written */
+	unsigned long long written;	/* Number of samples ever written */
+	struct sampler_slot *slots;
+};
+
+/* The subfeatures read with the same period */
+struct sampler_group {
+	unsigned long long period;	/* In ns */
+	unsigned long long due;
+	sensors_read_set *set;
+	int *rings;			/* Ring of each entry of set */
+	double *values;
+	int *errors;
+};
+
+struct sampler_stats {
+	double min;
+	double max;
+	double sum;
+};
+
+struct sensors_sampler {
+	sensors_context *ctx;
+	struct sampler_ring *rings;
+	struct sampler_slot *slots;
+	int *chips;			/* Chip index of each entry */
+	sensors_stream *stream;
+	int count;
+	int depth;
+	struct sampler_group *groups;
+	int group_count;
+	int timer_fd;
+	int stop_fd;
+	pthread_t thread;
+};
+
+static unsigned long long sampler_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void sampler_push(struct sampler_ring *ring, int depth,
+			 unsigned long long time, double value)
+{
+	struct sampler_slot *slot = &ring->slots[ring->written % depth];
+	unsigned int seq = ring->seq;
+
+	__atomic_store_n(&ring->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&slot->time, time, __ATOMIC_RELAXED);
+	__atomic_store(&slot->value, &value, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->written, ring->written + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void sampler_read_group(sensors_sampler *sampler,
+			       struct sampler_group *group)
+{
+	const sensors_read_set_entry *entries;
+	sensors_stream *stream;
+	sensors_stream_record record;
+	unsigned long long time;
+	int i, count;
+
+	sensors_read_set_sample(group->set, group->values, group->errors);
+	time = sampler_now();
+	record.time.tv_sec = time / NSEC_PER_SEC;
+	record.time.tv_nsec = time % NSEC_PER_SEC;
+
+	stream = __atomic_load_n(&sampler->stream, __ATOMIC_ACQUIRE);
+	entries = sensors_read_set_get_entries(group->set, &count);
+	for (i = 0; i < count; i++) {
+		if (group->errors[i])
+			continue;
+		sampler_push(&sampler->rings[group->rings[i]], sampler->depth,
+			     time, group->values[i]);
+		if (stream) {
+			record.chip = sampler->chips[group->rings[i]];
+			record.subfeat_nr = entries[i].subfeat_nr;
+			record.value = group->values[i];
+			sensors_stream_push(stream, &record);
+		}
+	}
+}
+
+static void *sampler_thread(void *arg)
+{
+	sensors_sampler *sampler = arg;
+	struct sampler_group *group;
+	struct itimerspec its;
+	struct pollfd pfd[2];
+	unsigned long long now, next, expirations;
+	int i;
+
+	memset(&its, 0, sizeof(its));
+	pfd[0].fd = sampler->timer_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = sampler->stop_fd;
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		now = sampler_now();
+		next = 0;
+		for (i = 0; i < sampler->group_count; i++) {
+			group = &sampler->groups[i];
+			if (group->due <= now) {
+				sampler_read_group(sampler, group);
+				group->due += group->period;
+				/* Don't try to catch up after a stall */
+				if (group->due <= now)
+					group->due = now + group->period;
+			}
+			if (!next || group->due < next)
+				next = group->due;
+		}
+
+		its.it_value.tv_sec = next / NSEC_PER_SEC;
+		its.it_value.tv_nsec = next % NSEC_PER_SEC;
+		timerfd_settime(sampler->timer_fd, TFD_TIMER_ABSTIME, &its,
+				NULL);
+
+		if (poll(pfd, 2, -1) < 0 && errno != EINTR)
+			break;
+		if (pfd[1].revents)
+			break;
+		if (pfd[0].revents &&
+		    read(sampler->timer_fd, &expirations,
+			 sizeof(expirations)) < 0 && errno != EAGAIN)
+			break;
+	}
+	return NULL;
+}
+
+/* Returns the index of a chip in the list of detected chips, -1 if not
+   found */
+static int sampler_chip_index(sensors_context *ctx,
+			      const sensors_chip_name *name)
+{
+	const sensors_chip_name *chip;
+	int nr = 0, i, index = -1;
+
+	for (i = 0; (chip = sensors_get_detected_chips_ctx(ctx, NULL, &nr));
+	     i++) {
+		/* Several chips may have the same name */
+		if (chip == name)
+			return i;
+		if (index < 0 && sensors_match_chip(chip, name))
+			index = i;
+	}
+	return index;
+}
+
+static int sampler_period_cmp(const void *a, const void *b)
+{
+	const sensors_sampler_entry *const *ea = a, *const *eb = b;
+
+	/* Keep the order of the entries within a group */
+	if ((*ea)->period != (*eb)->period)
+		return (*ea)->period < (*eb)->period ? -1 : 1;
+	return *ea < *eb ? -1 : *ea > *eb;
+}
+
+/* Prepare the read set of the count entries of a group, pointed to by
+   sorted. Returns 0 on success, <0 on error. */
+static int sampler_add_group(sensors_sampler *sampler,
+			     const sensors_sampler_entry *entries,
+			     const sensors_sampler_entry **sorted, int count,
+			     unsigned long long now)
+{
+	struct sampler_group *group = &sampler->groups[sampler->group_count];
+	sensors_read_set_entry *set_entries;
+	int i, res;
+
+	set_entries = malloc(count * sizeof(sensors_read_set_entry));
+	group->rings = malloc(count * sizeof(int));
+	group->values = malloc(count * sizeof(double));
+	group->errors = malloc(count * sizeof(int));
+	if (!set_entries || !group->rings || !group->values ||
+	    !group->errors)
+		sensors_fatal_error(__func__, "Out of memory");
+	sampler->group_count++;
+
+	for (i = 0; i < count; i++) {
+		set_entries[i].name = sorted[i]->name;
+		set_entries[i].subfeat_nr = sorted[i]->subfeat_nr;
+		group->rings[i] = sorted[i] - entries;
+	}
+	res = sensors_read_set_create_ctx(sampler->ctx, &group->set,
+					  set_entries, count);
+	free(set_entries);
+	if (res)
+		return res;
+
+	group->period = (sorted[0]->period > 0 ? sorted[0]->period : 1) *
+			NSEC_PER_MSEC;
+	group->due = now;
+	return 0;
+}
+
+int sensors_sampler_create(sensors_sampler **sampler,
+			   const sensors_sampler_entry *entries, int count,
+			   int depth)
+{
+	const sensors_sampler_entry **sorted;
+	sensors_sampler *new_sampler;
+	sigset_t all, old;
+	unsigned long long now;
+	int i, first, res;
+
+	if (count < 0)
+		return -SENSORS_ERR_NO_ENTRY;
+
+	new_sampler = calloc(1, sizeof(sensors_sampler));
+	if (!new_sampler)
+		sensors_fatal_error(__func__, "Out of memory");
+	new_sampler->timer_fd = new_sampler->stop_fd = -1;
+	new_sampler->count = count;
+	new_sampler->depth = depth > 0 ? depth : 1;
+	new_sampler->rings = calloc(count, sizeof(struct sampler_ring));
+	new_sampler->slots = calloc((size_t)count * new_sampler->depth,
+				    sizeof(struct sampler_slot));
+	new_sampler->chips = malloc(count * sizeof(int));
+	new_sampler->groups = calloc(count, sizeof(struct sampler_group));
+	sorted = malloc(count * sizeof(sensors_sampler_entry *));
+	if (count && (!new_sampler->rings || !new_sampler->slots ||
+		      !new_sampler->chips || !new_sampler->groups || !sorted))
+		sensors_fatal_error(__func__, "Out of memory");
+	for (i = 0; i < count; i++) {
+		new_sampler->rings[i].slots = new_sampler->slots +
+					      (size_t)i * new_sampler->depth;
+		sorted[i] = &entries[i];
+	}
+
+	/* The chip names must remain valid even if another context gets
+	   published */
+	new_sampler->ctx = sensors_context_acquire();
+	for (i = 0; i < count; i++)
+		new_sampler->chips[i] = sampler_chip_index(new_sampler->ctx,
+							   entries[i].name);
+
+	/* One read set per period */
+	qsort(sorted, count, sizeof(sensors_sampler_entry *),
+	      sampler_period_cmp);
+	now = sampler_now();
+	for (first = 0, i = 1; i <= count; i++) {
+		if (i < count && sorted[i]->period == sorted[first]->period)
+			continue;
+		res = sampler_add_group(new_sampler, entries, sorted + first,
+					i - first, now);
+		if (res) {
+			free(sorted);
+			sensors_sampler_free(new_sampler);
+			return res;
+		}
+		first = i;
+	}
+	free(sorted);
+
+	new_sampler->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+					       TFD_NONBLOCK | TFD_CLOEXEC);
+	new_sampler->stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (new_sampler->timer_fd < 0 || new_sampler->stop_fd < 0) {
+		sensors_sampler_free(new_sampler);
+		return -SENSORS_ERR_KERNEL;
+	}
+
+	/* Signals are for the threads of the application */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	res = pthread_create(&new_sampler->thread, NULL, sampler_thread,
+			     new_sampler);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (res) {
+		close(new_sampler->stop_fd);
+		new_sampler->stop_fd = -1;
+		sensors_sampler_free(new_sampler);
+		return -SENSORS_ERR_KERNEL;
+	}
+
+	*sampler = new_sampler;
+	return 0;
+}
+
+/* Copy the last count samples of a ring to samples if not NULL, and add
+   them to stats if not NULL. Returns the number of samples. */
+static int sampler_read(const sensors_sampler *sampler, int index,
+			sensors_sample *samples, int count,
+			struct sampler_stats *stats)
+{
+	const struct sampler_ring *ring = &sampler->rings[index];
+	const struct sampler_slot *slot;
+	unsigned long long written, time;
+	unsigned int seq;
+	double value;
+	int i, n;
+
+	for (;;) {
+		seq = __atomic_load_n(&ring->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;	/* Not for long */
+
+		written = __atomic_load_n(&ring->written, __ATOMIC_RELAXED);
+		n = count;
+		if ((unsigned long long)n > written)
+			n = written;
+		if (n > sampler->depth)
+			n = sampler->depth;
+
+		for (i = 0; i < n; i++) {
+			slot = &ring->slots[(written - n + i) % sampler->depth];
+			time = __atomic_load_n(&slot->time, __ATOMIC_RELAXED);
+			__atomic_load(&slot->value, &value, __ATOMIC_RELAXED);
+			if (samples) {
+				samples[i].time.tv_sec = time / NSEC_PER_SEC;
+				samples[i].time.tv_nsec = time % NSEC_PER_SEC;
+				samples[i].value = value;
+			}
+			if (stats) {
+				if (!i || value < stats->min)
+					stats->min = value;
+				if (!i || value > stats->max)
+					stats->max = value;
+				stats->sum = (i ? stats->sum : 0) + value;
+			}
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&ring->seq, __ATOMIC_RELAXED) == seq)
+			return n;
+	}
+}
+
+void sensors_sampler_set_stream(sensors_sampler *sampler,
+				sensors_stream *stream)
+{
+	__atomic_store_n(&sampler->stream, stream, __ATOMIC_RELEASE);
+}
+
+int sensors_sampler_history(const sensors_sampler *sampler, int index,
+			    sensors_sample *samples, int count)
+{
+	if (index < 0 || index >= sampler->count || count < 0)
+		return -SENSORS_ERR_NO_ENTRY;
+	return sampler_read(sampler, index, samples, count, NULL);
+}
+
+int sensors_sampler_stats(const sensors_sampler *sampler, int index,
+			  int count, double *min, double *max, double *mean)
+{
+	struct sampler_stats stats;
+	int n;
+
+	if (index < 0 || index >= sampler->count || count < 0)
+		return -SENSORS_ERR_NO_ENTRY;
+	n = sampler_read(sampler, index, NULL, count, &stats);
+	if (n) {
+		*min = stats.min;
+		*max = stats.max;
+		*mean = stats.sum / n;
+	}
+	return n;
+}
+
+void sensors_sampler_free(sensors_sampler *sampler)
+{
+	unsigned long long one = 1;
+	int i;
+
+	if (!sampler)
+		return;
+
+	if (sampler->stop_fd >= 0) {
+		while (write(sampler->stop_fd, &one, sizeof(one)) < 0 &&
+		       errno == EINTR)
+			;
+		pthread_join(sampler->thread, NULL);
+		close(sampler->stop_fd);
+	}
+	if (sampler->timer_fd >= 0)
+		close(sampler->timer_fd);
+
+	for (i = 0; i < sampler->group_count; i++) {
+		sensors_read_set_free(sampler->groups[i].set);
+		free(sampler->groups[i].rings);
+		free(sampler->groups[i].values);
+		free(sampler->groups[i].errors);
+	}
+	free(sampler->groups);
+	free(sampler->rings);
+	free(sampler->slots);
+	free(sampler->chips);
+	sensors_context_release(sampler->ctx);
+	free(sampler);
+}
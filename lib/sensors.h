@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <limits.h>
+#include <time.h>
 
 /* Publicly accessible library functions */
 
@@ -31,7 +32,7 @@
    when the API or ABI breaks), the third digit is incremented to track small
    API additions like new flags / enum values. The second digit is for tracking
    larger additions like new methods. */
-#define SENSORS_API_VERSION		0x500
+#define SENSORS_API_VERSION		0x510
 
 #define SENSORS_CHIP_NAME_PREFIX_ANY	NULL
 #define SENSORS_CHIP_NAME_ADDR_ANY	(-1)
@@ -75,10 +76,188 @@ typedef struct sensors_chip_name {
    calling sensors_init() again. */
 int sensors_init(FILE *input);
 
+/* Same as sensors_init(), but only the chips matching at least one of the
+   count names of match (which may contain wildcards) are detected. The
+   other chips are skipped as early as possible, and the chip statements of
+   the configuration file which can't apply to any of the matching chips
+   are dropped. If match is NULL, all chips are detected. */
+int sensors_init_filtered(FILE *input, const sensors_chip_name *match,
+			  int count);
+
 /* Clean-up function: You can't access anything after
    this, until the next sensors_init() call! */
 void sensors_cleanup(void);
 
+/* Library options, see sensors_set_option() below */
+#define SENSORS_OPT_CACHE_FDS		1
+#define SENSORS_OPT_INIT_THREADS	2
+
+/* Set a library option. SENSORS_OPT_CACHE_FDS: if value is non-zero,
+   attribute files are opened once and kept open until sensors_cleanup(),
+   instead of being opened and closed at every read. Those which went away
+   are not opened again until then.
+   SENSORS_OPT_INIT_THREADS: if value is greater than 1, sensors_init()
+   enumerates the hwmon devices with up to value threads. The chips are
+   listed in the same order either way.
+   Options are not reset by sensors_cleanup(). This function will return
+   0 on success, and <0 on failure. */
+int sensors_set_option(int option, int value);
+
+/* Keep the list of detected chips and busses, and the features of the
+   chips, in a cache file at path, so that the next sensors_init() doesn't
+   have to discover them again. The cache is only used if neither the
+   system was rebooted nor a hwmon or i2c adapter device came or went since
+   it was written, and is rewritten otherwise, by unfiltered calls of
+   sensors_init() and sensors_init_filtered(). The directory must be
+   writable for that. If path is NULL, no cache is used, which is the
+   default. Not reset by sensors_cleanup(). This function will return 0 on
+   success, and <0 on failure. */
+int sensors_set_cache_file(const char *path);
+
+/* Open a socket receiving the kernel device events, so that the list of
+   detected chips can follow hwmon devices which come and go. Returns a file
+   descriptor to poll for reading, or <0 on failure. The socket is the same
+   across calls, and is kept until sensors_hotplug_close(), even by
+   sensors_cleanup(). */
+int sensors_hotplug_open(void);
+
+/* Add and remove chips as the pending device events say, without waiting.
+   Chip names returned before remain valid. Those of removed chips can't be
+   used to access them any longer, they can't be found. A chip whose device
+   comes back gets its features discovered again: those returned before
+   are no longer found. The published context is changed in place, so this
+   must not be called while other threads use the library. It fails with
+   SENSORS_ERR_BUSY, leaving the events pending, while references to the
+   published context are held, see sensors_context_acquire(), as samplers
+   and alarm notifications do. Initialize a new context and publish it
+   instead, then. Returns the number of chips added or removed, or <0 on
+   failure. */
+int sensors_hotplug_process(void);
+
+void sensors_hotplug_close(void);
+
+/* A change of an alarm or fault subfeature, as reported by
+   sensors_alarm_drain() */
+typedef struct sensors_alarm_event {
+	const sensors_chip_name *name;
+	int subfeat_nr;
+	double value;
+} sensors_alarm_event;
+
+/* Watch all the readable alarm and fault subfeatures of the chips of the
+   published context. Returns a file descriptor to poll for reading, which
+   becomes readable as soon as the driver notifies a change, or <0 on
+   failure. Drivers may not notify: unless interval is 0, subfeatures are
+   also read every interval milliseconds, until they were seen notifying.
+   The chip names of the published context remain valid until
+   sensors_alarm_close(). The file descriptor is the same across calls,
+   chips detected later are only watched after sensors_alarm_close() and
+   sensors_alarm_open() again. */
+int sensors_alarm_open(int interval);
+
+/* Store the subfeatures whose value changed since they were last reported,
+   at most count of them, in events, without waiting. Returns the number of
+   events stored, or <0 on failure. Changes which don't fit are reported by
+   the next call, so call again as long as events is filled. Must not be
+   called from several threads at once. */
+int sensors_alarm_drain(sensors_alarm_event *events, int count);
+
+void sensors_alarm_close(void);
+
+/* A sampler reads subfeatures periodically in a thread of its own, and
+   keeps their last values, so that any number of threads can get them
+   without reading the attributes themselves. */
+typedef struct sensors_sampler sensors_sampler;
+
+typedef struct sensors_sampler_entry {
+	const sensors_chip_name *name;
+	int subfeat_nr;
+	int period;		/* In ms, at least 1 */
+} sensors_sampler_entry;
+
+typedef struct sensors_sample {
+	struct timespec time;	/* CLOCK_MONOTONIC */
+	double value;
+} sensors_sample;
+
+/* Start sampling count (chip, subfeature) pairs of the published context,
+   keeping the last depth values of each. Subfeatures are read as with
+   sensors_get_value(), those with the same period together; failed reads
+   are not kept. The context remains referenced until the sampler is freed.
+   On success, the new sampler is stored in *sampler. This function will
+   return 0 on success, and <0 on failure, including a negative count. */
+int sensors_sampler_create(sensors_sampler **sampler,
+			   const sensors_sampler_entry *entries, int count,
+			   int depth);
+
+/* Copy the last count values of entry index of a sampler to samples, oldest
+   first; count 1 gives the latest value. These and the function below
+   never block the sampler nor make system calls, and can be called from
+   any thread. Returns the number of samples copied, fewer than count if
+   not that many were kept, or <0 on failure, including a negative
+   count. */
+int sensors_sampler_history(const sensors_sampler *sampler, int index,
+			    sensors_sample *samples, int count);
+
+/* Get the minimum, maximum and mean of the last count values of entry
+   index. Returns the number of values used, 0 if none was kept yet, or <0
+   on failure, including a negative count. */
+int sensors_sampler_stats(const sensors_sampler *sampler, int index,
+			  int count, double *min, double *max, double *mean);
+
+/* Stop and free a sampler. */
+void sensors_sampler_free(sensors_sampler *sampler);
+
+/* A stream is a ring of sample records, pushed by a single producer, and
+   read by any number of consumers, each of which gets every record unless
+   it falls too far behind. Neither producer nor consumers ever wait. */
+typedef struct sensors_stream sensors_stream;
+
+typedef struct sensors_stream_record {
+	struct timespec time;	/* CLOCK_MONOTONIC */
+	int chip;		/* Index in the list of detected chips */
+	int subfeat_nr;
+	double value;
+} sensors_stream_record;
+
+/* The position of a consumer in a stream. lost counts the records it
+   missed because they were overwritten before it read them. */
+typedef struct sensors_stream_cursor {
+	unsigned long long next;
+	unsigned long long lost;
+} sensors_stream_cursor;
+
+/* Allocate a stream keeping the last size records, rounded up to a power
+   of 2. */
+sensors_stream *sensors_stream_new(int size);
+
+/* Add a record to a stream, overwriting the oldest one. Only one thread
+   may push records to a given stream. */
+void sensors_stream_push(sensors_stream *stream,
+			 const sensors_stream_record *record);
+
+/* Start reading a stream from the next record to be pushed. */
+void sensors_stream_cursor_init(const sensors_stream *stream,
+				sensors_stream_cursor *cursor);
+
+/* Copy the records following the cursor, at most count of them, to
+   records, and advance the cursor. If some were overwritten, the cursor
+   skips to the oldest record left, and counts them in cursor->lost. Can be
+   called from any number of threads, each with its own cursor. Returns
+   the number of records copied. */
+int sensors_stream_read(const sensors_stream *stream,
+			sensors_stream_cursor *cursor,
+			sensors_stream_record *records, int count);
+
+/* Free a stream, once nobody uses it any longer. */
+void sensors_stream_free(sensors_stream *stream);
+
+/* Push every value a sampler keeps to stream as well, or stop doing so if
+   stream is NULL. The sampler thread then is the producer of stream, which
+   must not be freed before the sampler. */
+void sensors_sampler_set_stream(sensors_sampler *sampler,
+				sensors_stream *stream);
+
 /* Parse a chip name to the internal representation. Return 0 on success, <0
    on error. */
 int sensors_parse_chip_name(const char *orig_name, sensors_chip_name *res);
@@ -106,6 +285,12 @@ typedef struct sensors_feature sensors_feature;
 char *sensors_get_label(const sensors_chip_name *name,
 			const sensors_feature *feature);
 
+/* Same as above, but the label is cached, and the returned string must not
+   be freed. It remains valid until sensors_cleanup() is called. The
+   feature must have been returned by sensors_get_features(). */
+const char *sensors_get_label_const(const sensors_chip_name *name,
+				    const sensors_feature *feature);
+
 /* Read the value of a subfeature of a certain chip. Note that chip should not
    contain wildcard values! This function will return 0 on success, and <0
    on failure.  */
@@ -122,6 +307,46 @@ int sensors_set_value(const sensors_chip_name *name, int subfeat_nr,
    wildcards!  This function will return 0 on success, and <0 on failure. */
 int sensors_do_chip_sets(const sensors_chip_name *name);
 
+/* A read set is a prepared list of subfeatures, which can then be read
+   all at once, with all the lookups done only once. */
+typedef struct sensors_read_set sensors_read_set;
+
+typedef struct sensors_read_set_entry {
+	const sensors_chip_name *name;
+	int subfeat_nr;
+} sensors_read_set_entry;
+
+/* Prepare a read set from count (chip, subfeature) pairs. Note that chips
+   should not contain wildcard values! On success, the new set is stored
+   in *set; free it with sensors_read_set_free() before calling
+   sensors_cleanup(). This function will return 0 on success, and <0 on
+   failure, including a negative count. */
+int sensors_read_set_create(sensors_read_set **set,
+			    const sensors_read_set_entry *entries, int count);
+
+/* Prepare a read set with all the readable subfeatures of all detected
+   chips, except for ignored features. This function will return 0 on
+   success, and <0 on failure. */
+int sensors_read_set_create_all(sensors_read_set **set);
+
+/* Return the (chip, subfeature) pairs of a read set, and store their number
+   in *count. The returned array belongs to the read set. */
+const sensors_read_set_entry *
+sensors_read_set_get_entries(const sensors_read_set *set, int *count);
+
+/* Read the values of all subfeatures of a read set, in the order in which
+   they were given to sensors_read_set_create(). All the attributes are
+   read as a single batch, and are kept open until sensors_cleanup() is
+   called. A read set must not be sampled from several threads at once.
+   If errors is not NULL, the result of each individual read is stored in
+   it. This function will return 0 on success, and <0 (the last error) if
+   any read failed. */
+int sensors_read_set_sample(sensors_read_set *set, double *values,
+			    int *errors);
+
+/* Free a read set. */
+void sensors_read_set_free(sensors_read_set *set);
+
 /* This function returns all detected chips that match a given chip name,
    one by one. If no chip name is provided, all detected chips are returned.
    To start at the beginning of the list, use 0 for nr; NULL is returned if
@@ -309,6 +534,88 @@ sensors_get_subfeature(const sensors_chip_name *name,
 		       const sensors_feature *feature,
 		       sensors_subfeature_type type);
 
+/* A context holds a configuration and the chips detected with it, so that
+   independent ones can coexist in a process. All the functions above work
+   on the published context, see sensors_context_publish(); each has a
+   *_ctx() counterpart below working on the given context instead, with
+   the same semantics. A context can be used from any number of threads at
+   once once initialized, but must not be initialized or cleaned up while
+   in use. Library options, the cache file and hotplug events are not per
+   context: hotplug events only apply to the published context. */
+typedef struct sensors_context sensors_context;
+
+/* Allocate a new context, with neither configuration nor chips: call
+   sensors_init_ctx() next. The caller holds the only reference to it. */
+sensors_context *sensors_context_new(void);
+
+/* Drop the reference returned by sensors_context_new(). Same as
+   sensors_context_release(). */
+void sensors_context_free(sensors_context *ctx);
+
+/* Return the published context, with a new reference which the caller
+   must drop with sensors_context_release(). The context, and the chip
+   names, features and labels obtained from it, remain valid until then,
+   even if another context is published in the meantime. This function
+   never blocks. While references are held, sensors_hotplug_process(),
+   which changes the published context in place, refuses to run. */
+sensors_context *sensors_context_acquire(void);
+
+/* Drop a reference to a context. The context is cleaned up and freed once
+   no reference is left. */
+void sensors_context_release(sensors_context *ctx);
+
+/* Make ctx, which must be initialized, the context used by the functions
+   without _ctx(), taking over the reference of the caller. The reference
+   held by the publication on the previous context is dropped, so it is
+   freed once the last reader releases it. Readers are never blocked;
+   this function waits for sensors_context_acquire() calls in progress.
+   Threads calling the functions without _ctx() while another context is
+   published are not protected: those needing that should acquire the
+   context and use the *_ctx() functions. Initially, the published context
+   is the one sensors_init() initializes. */
+void sensors_context_publish(sensors_context *ctx);
+
+int sensors_init_ctx(sensors_context *ctx, FILE *input);
+int sensors_init_filtered_ctx(sensors_context *ctx, FILE *input,
+			      const sensors_chip_name *match, int count);
+void sensors_cleanup_ctx(sensors_context *ctx);
+const char *sensors_get_adapter_name_ctx(sensors_context *ctx,
+					 const sensors_bus_id *bus);
+char *sensors_get_label_ctx(sensors_context *ctx,
+			    const sensors_chip_name *name,
+			    const sensors_feature *feature);
+const char *sensors_get_label_const_ctx(sensors_context *ctx,
+					const sensors_chip_name *name,
+					const sensors_feature *feature);
+int sensors_get_value_ctx(sensors_context *ctx,
+			  const sensors_chip_name *name, int subfeat_nr,
+			  double *value);
+int sensors_set_value_ctx(sensors_context *ctx,
+			  const sensors_chip_name *name, int subfeat_nr,
+			  double value);
+int sensors_do_chip_sets_ctx(sensors_context *ctx,
+			     const sensors_chip_name *name);
+int sensors_read_set_create_ctx(sensors_context *ctx, sensors_read_set **set,
+				const sensors_read_set_entry *entries,
+				int count);
+int sensors_read_set_create_all_ctx(sensors_context *ctx,
+				    sensors_read_set **set);
+const sensors_chip_name *
+sensors_get_detected_chips_ctx(sensors_context *ctx,
+			       const sensors_chip_name *match, int *nr);
+const sensors_feature *
+sensors_get_features_ctx(sensors_context *ctx,
+			 const sensors_chip_name *name, int *nr);
+const sensors_subfeature *
+sensors_get_all_subfeatures_ctx(sensors_context *ctx,
+				const sensors_chip_name *name,
+				const sensors_feature *feature, int *nr);
+const sensors_subfeature *
+sensors_get_subfeature_ctx(sensors_context *ctx,
+			   const sensors_chip_name *name,
+			   const sensors_feature *feature,
+			   sensors_subfeature_type type);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,163 @@
+/*
+    stream.c - Part of libsensors, a Linux library for reading sensor data.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * A stream is a ring of records with a single producer and any number of
+ * consumers, each of which gets every record. The producer never waits
+ * for consumers: it overwrites the oldest record, and consumers which fell
+ * behind notice it and skip ahead.
+ *
+ * Each slot has a sequence number: 2 * pos + 1 while record number pos is
+ * written to it, 2 * pos + 2 once it is complete. Consumers copy the
+ * record, then check that the sequence number didn't change, so they never
+ * return a record being overwritten. Consumers only read shared memory,
+ * so they don't slow each other down.
+ */
+
+#include <stdlib.h>
+#include "sensors.h"
+#include "error.h"
+
+struct stream_slot {
+	unsigned long long seq;
+	unsigned long long time;	/* CLOCK_MONOTONIC, in ns */
+	double value;
+	int chip;
+	int subfeat_nr;
+};
+
+struct sensors_stream {
+	unsigned long long head;	/* Number of records ever pushed */
+	unsigned long long mask;	/* Number of slots - 1 */
+	struct stream_slot *slots;
+};
+
+#define NSEC_PER_SEC	1000000000ULL
+
+sensors_stream *sensors_stream_new(int size)
+{
+	sensors_stream *stream;
+	unsigned long long slots = 1;
+
+	/* A power of 2, so that positions map to slots with a mask */
+	while (slots < (unsigned long long)size)
+		slots <<= 1;
+
+	stream = malloc(sizeof(sensors_stream));
+	if (!stream)
+		sensors_fatal_error(__func__, "Out of memory");
+	stream->slots = calloc(slots, sizeof(struct stream_slot));
+	if (!stream->slots)
+		sensors_fatal_error(__func__, "Out of memory");
+	stream->head = 0;
+	stream->mask = slots - 1;
+
+	return stream;
+}
+
+void sensors_stream_free(sensors_stream *stream)
+{
+	if (!stream)
+		return;
+	free(stream->slots);
+	free(stream);
+}
+
+void sensors_stream_push(sensors_stream *stream,
+			 const sensors_stream_record *record)
+{
+	unsigned long long pos = stream->head;
+	struct stream_slot *slot = &stream->slots[pos & stream->mask];
+	unsigned long long time = record->time.tv_sec * NSEC_PER_SEC +
+				  record->time.tv_nsec;
+
+	__atomic_store_n(&slot->seq, 2 * pos + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&slot->time, time, __ATOMIC_RELAXED);
+	__atomic_store(&slot->value, &record->value, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->chip, record->chip, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->subfeat_nr, record->subfeat_nr,
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->seq, 2 * pos + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&stream->head, pos + 1, __ATOMIC_RELEASE);
+}
+
+void sensors_stream_cursor_init(const sensors_stream *stream,
+				sensors_stream_cursor *cursor)
+{
+	cursor->next = __atomic_load_n(&stream->head, __ATOMIC_ACQUIRE);
+	cursor->lost = 0;
+}
+
+/* Copy record number pos. Returns 1 if it was copied, 0 if it wasn't
+   pushed yet, -1 if it was overwritten. */
+static int stream_copy(const sensors_stream *stream, unsigned long long pos,
+		       sensors_stream_record *record)
+{
+	const struct stream_slot *slot = &stream->slots[pos & stream->mask];
+	unsigned long long seq, time;
+
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+	if (seq < 2 * pos + 2)
+		return 0;
+	if (seq > 2 * pos + 2)
+		return -1;
+
+	time = __atomic_load_n(&slot->time, __ATOMIC_RELAXED);
+	__atomic_load(&slot->value, &record->value, __ATOMIC_RELAXED);
+	record->chip = __atomic_load_n(&slot->chip, __ATOMIC_RELAXED);
+	record->subfeat_nr = __atomic_load_n(&slot->subfeat_nr,
+					     __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+		return -1;
+
+	record->time.tv_sec = time / NSEC_PER_SEC;
+	record->time.tv_nsec = time % NSEC_PER_SEC;
+	return 1;
+}
+
+int sensors_stream_read(const sensors_stream *stream,
+			sensors_stream_cursor *cursor,
+			sensors_stream_record *records, int count)
+{
+	unsigned long long head, oldest;
+	int n = 0, res;
+
+	while (n < count) {
+		res = stream_copy(stream, cursor->next, &records[n]);
+		if (!res)
+			break;
+		if (res > 0) {
+			cursor->next++;
+			n++;
+			continue;
+		}
+
+		/* Overrun: skip to the oldest record which is not being
+		   overwritten */
+		head = __atomic_load_n(&stream->head, __ATOMIC_ACQUIRE);
+		oldest = head - stream->mask;
+		if (oldest > cursor->next) {
+			cursor->lost += oldest - cursor->next;
+			cursor->next = oldest;
+		}
+	}
+	return n;
+}
@@ -25,17 +25,24 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/vfs.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <ctype.h>
 #include <errno.h>
 #include <dirent.h>
+#include <pthread.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
 #include "data.h"
 #include "error.h"
 #include "access.h"
 #include "general.h"
 #include "sysfs.h"
+#include "arena.h"
 
 
 /****************************************************************************/
@@ -182,15 +189,10 @@ char *get_feature_name(sensors_feature_type ftype, char *sfname)
 	case SENSORS_FEATURE_HUMIDITY:
 	case SENSORS_FEATURE_INTRUSION:
 		underscore = strchr(sfname, '_');
-		name = strndup(sfname, underscore - sfname);
-		if (!name)
-			sensors_fatal_error(__func__, "Out of memory");
-
+		name = sensors_intern_n(sfname, underscore - sfname);
 		break;
 	default:
-		name = strdup(sfname);
-		if (!name)
-			sensors_fatal_error(__func__, "Out of memory");
+		name = sensors_intern(sfname);
 	}
 
 	return name;
@@ -329,26 +331,141 @@ static const struct subfeature_type_match intrusion_matches[] = {
 	{ "beep", SENSORS_SUBFEATURE_INTRUSION_BEEP },
 	{ NULL, 0 }
 };
-static struct feature_type_match matches[] = {
-	{ "temp%d%c", temp_matches },
-	{ "in%d%c", in_matches },
-	{ "fan%d%c", fan_matches },
-	{ "cpu%d%c", cpu_matches },
-	{ "power%d%c", power_matches },
-	{ "curr%d%c", curr_matches },
-	{ "energy%d%c", energy_matches },
-	{ "intrusion%d%c", intrusion_matches },
-	{ "humidity%d%c", humidity_matches },
+/* Keep in sync with sensors_match_prefix() */
+static const struct feature_type_match matches[] = {
+	{ "temp", temp_matches },
+	{ "in", in_matches },
+	{ "fan", fan_matches },
+	{ "cpu", cpu_matches },
+	{ "power", power_matches },
+	{ "curr", curr_matches },
+	{ "energy", energy_matches },
+	{ "intrusion", intrusion_matches },
+	{ "humidity", humidity_matches },
 };
 
+/* Perfect hash tables of the subfeature names, one per entry of matches[],
+   so that the suffix of an attribute name can be classified with a single
+   string comparison. The seed of each table is picked at run time, the
+   first one for which no two names collide. The tables are built once,
+   by whichever thread classifies a name first. */
+#define SUFFIX_HASH_SIZE	64
+
+static struct suffix_hash {
+	unsigned int seed;
+	const struct subfeature_type_match *slot[SUFFIX_HASH_SIZE];
+} suffix_hash[ARRAY_SIZE(matches)];
+static pthread_once_t suffix_hash_once = PTHREAD_ONCE_INIT;
+
+static unsigned int suffix_hash_fn(const char *name, unsigned int seed)
+{
+	unsigned int hash = 2166136261U ^ seed;
+
+	while (*name)
+		hash = (hash ^ (unsigned char)*name++) * 16777619U;
+	return (hash ^ (hash >> 16)) % SUFFIX_HASH_SIZE;
+}
+
+static void sensors_init_suffix_hash(void)
+{
+	const struct subfeature_type_match *submatches;
+	struct suffix_hash *h;
+	unsigned int i, j, slot;
+
+	for (i = 0; i < ARRAY_SIZE(matches); i++) {
+		submatches = matches[i].submatches;
+		h = &suffix_hash[i];
+retry:
+		memset(h->slot, 0, sizeof(h->slot));
+		for (j = 0; submatches[j].name != NULL; j++) {
+			slot = suffix_hash_fn(submatches[j].name, h->seed);
+			if (h->slot[slot]) {
+				h->seed++;
+				goto retry;
+			}
+			h->slot[slot] = &submatches[j];
+		}
+	}
+}
+
+/* Return the index in matches[] of the feature type name which starts
+   name, or -1 if none does */
+static int sensors_match_prefix(const char *name)
+{
+	int i;
+
+	switch (name[0]) {
+	case 't':
+		i = 0;
+		break;
+	case 'i':
+		/* "in" is a prefix of "intrusion", but is always followed
+		   by a number */
+		i = name[1] == 'n' && name[2] == 't' ? 7 : 1;
+		break;
+	case 'f':
+		i = 2;
+		break;
+	case 'c':
+		i = name[1] == 'p' ? 3 : 5;
+		break;
+	case 'p':
+		i = 4;
+		break;
+	case 'e':
+		i = 6;
+		break;
+	case 'h':
+		i = 8;
+		break;
+	default:
+		return -1;
+	}
+
+	if (strncmp(name, matches[i].name, strlen(matches[i].name)))
+		return -1;
+	return i;
+}
+
+/* Parse a decimal channel number the way sscanf("%d") does: leading white
+   space and sign are accepted, and out-of-range values are clamped to the
+   range of long before being converted to int. Returns a pointer to the
+   first character after the number, or NULL if there is no number. */
+static const char *sensors_parse_channel(const char *s, int *nr)
+{
+	unsigned long val = 0, limit;
+	int neg = 0, overflow = 0, digit;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	if (*s == '-' || *s == '+')
+		neg = *s++ == '-';
+	if (*s < '0' || *s > '9')
+		return NULL;
+
+	limit = neg ? 0UL - (unsigned long)LONG_MIN : (unsigned long)LONG_MAX;
+	for (; *s >= '0' && *s <= '9'; s++) {
+		digit = *s - '0';
+		if (val > (limit - digit) / 10)
+			overflow = 1;
+		else
+			val = val * 10 + digit;
+	}
+	if (overflow)
+		val = limit;
+
+	*nr = (int)(neg ? (long)(0UL - val) : (long)val);
+	return s;
+}
+
 /* Return the subfeature type and channel number based on the subfeature
-   name */
-static
+   name. This is called for every file of every hwmon device, so it avoids
+   sscanf() and string table scans. */
 sensors_subfeature_type sensors_subfeature_get_type(const char *name, int *nr)
 {
-	char c;
-	int i, count;
-	const struct subfeature_type_match *submatches;
+	const struct subfeature_type_match *match;
+	const struct suffix_hash *h;
+	int i;
 
 	/* Special case */
 	if (!strcmp(name, "beep_enable")) {
@@ -356,18 +473,20 @@ sensors_subfeature_type sensors_subfeature_get_type(const char *name, int *nr)
 		return SENSORS_SUBFEATURE_BEEP_ENABLE;
 	}
 
-	for (i = 0; i < ARRAY_SIZE(matches); i++)
-		if ((count = sscanf(name, matches[i].name, nr, &c)))
-			break;
+	i = sensors_match_prefix(name);
+	if (i < 0)
+		return SENSORS_SUBFEATURE_UNKNOWN;  /* no match */
 
-	if (i == ARRAY_SIZE(matches) || count != 2 || c != '_')
+	name = sensors_parse_channel(name + strlen(matches[i].name), nr);
+	if (!name || *name != '_')
 		return SENSORS_SUBFEATURE_UNKNOWN;  /* no match */
+	name++;
 
-	submatches = matches[i].submatches;
-	name = strchr(name + 3, '_') + 1;
-	for (i = 0; submatches[i].name != NULL; i++)
-		if (!strcmp(name, submatches[i].name))
-			return submatches[i].type;
+	pthread_once(&suffix_hash_once, sensors_init_suffix_hash);
+	h = &suffix_hash[i];
+	match = h->slot[suffix_hash_fn(name, h->seed)];
+	if (match && !strcmp(name, match->name))
+		return match->type;
 
 	return SENSORS_SUBFEATURE_UNKNOWN;
 }
@@ -399,14 +518,16 @@ static int sensors_compute_max_sf(void)
 	return max;
 }
 
-static int sensors_get_attr_mode(const char *device, const char *attr)
+/* Get the access mode of an attribute, relative to the open directory of
+   its device, so that the path doesn't have to be resolved again. Only
+   regular files are considered, so not following symbolic links doesn't
+   change anything. */
+static int sensors_get_attr_mode(int dirfd, const char *attr)
 {
-	char path[NAME_MAX];
 	struct stat st;
 	int mode = 0;
 
-	snprintf(path, NAME_MAX, "%s/%s", device, attr);
-	if (!stat(path, &st)) {
+	if (!fstatat(dirfd, attr, &st, AT_SYMLINK_NOFOLLOW)) {
 		if (st.st_mode & S_IRUSR)
 			mode |= SENSORS_MODE_R;
 		if (st.st_mode & S_IWUSR)
@@ -415,180 +536,245 @@ static int sensors_get_attr_mode(const char *device, const char *attr)
 	return mode;
 }
 
-static int sensors_read_dynamic_chip(sensors_chip_features *chip,
-				     const char *dev_path)
+/* Return the subfeature type and channel number of a directory entry,
+   SENSORS_SUBFEATURE_UNKNOWN if it isn't a valid attribute */
+static sensors_subfeature_type sensors_get_attr_type(const struct dirent *ent,
+						     int *nr)
+{
+	sensors_subfeature_type sftype;
+
+	/* Skip directories and symlinks */
+	if (ent->d_type != DT_REG)
+		return SENSORS_SUBFEATURE_UNKNOWN;
+
+	sftype = sensors_subfeature_get_type(ent->d_name, nr);
+	if (sftype == SENSORS_SUBFEATURE_UNKNOWN)
+		return sftype;
+
+	/* Adjust the channel number */
+	switch (sftype >> 8) {
+	case SENSORS_FEATURE_FAN:
+	case SENSORS_FEATURE_TEMP:
+	case SENSORS_FEATURE_POWER:
+	case SENSORS_FEATURE_ENERGY:
+	case SENSORS_FEATURE_CURR:
+	case SENSORS_FEATURE_HUMIDITY:
+		(*nr)--;
+		break;
+	default:
+		break;
+	}
+
+	/* Skip invalid entries */
+	if (*nr < 0) {
+#ifdef DEBUG
+		sensors_fatal_error(__func__, "Invalid channel number!");
+#endif
+		return SENSORS_SUBFEATURE_UNKNOWN;
+	}
+
+	return sftype;
+}
+
+/* Check whether a directory contains at least one attribute we know
+   about, without looking at the others. Returns 1 if it does, 0 if not,
+   and <0 on error. */
+static int sensors_has_attrs(const char *dev_path)
 {
-	int i, fnum = 0, sfnum = 0, prev_slot;
-	static int max_subfeatures, feature_size;
 	DIR *dir;
 	struct dirent *ent;
-	struct {
-		int count;
-		sensors_subfeature *sf;
-	} all_types[SENSORS_FEATURE_MAX];
-	sensors_subfeature *dyn_subfeatures;
-	sensors_feature *dyn_features;
-	sensors_feature_type ftype;
-	sensors_subfeature_type sftype;
+	int nr, found = 0;
 
 	if (!(dir = opendir(dev_path)))
 		return -errno;
 
-	/* Dynamically figure out the max number of subfeatures */
-	if (!max_subfeatures) {
-		max_subfeatures = sensors_compute_max_sf();
-		feature_size = max_subfeatures * 2;
-	}
+	while (!found && (ent = readdir(dir)))
+		found = sensors_get_attr_type(ent, &nr) !=
+			SENSORS_SUBFEATURE_UNKNOWN;
+	closedir(dir);
 
-	/* We use a set of large sparse tables at first (one per main
-	   feature type present) to store all found subfeatures, so that we
-	   can store them sorted and then later create a dense sorted table. */
-	memset(&all_types, 0, sizeof(all_types));
+	return found;
+}
 
-	while ((ent = readdir(dir))) {
-		char *name;
-		int nr;
+/* Size of the sparse subfeature tables, per feature: see
+   sensors_init_feature_size(). Set once, by whichever thread needs them
+   first. */
+static int max_subfeatures, feature_size;
+static pthread_once_t feature_size_once = PTHREAD_ONCE_INIT;
 
-		/* Skip directories and symlinks */
-		if (ent->d_type != DT_REG)
-			continue;
+static void sensors_compute_feature_size(void)
+{
+	/* Dynamically figure out the max number of subfeatures */
+	max_subfeatures = sensors_compute_max_sf();
+	feature_size = max_subfeatures * 2;
+}
 
-		name = ent->d_name;
+static void sensors_init_feature_size(void)
+{
+	pthread_once(&feature_size_once, sensors_compute_feature_size);
+}
 
-		sftype = sensors_subfeature_get_type(name, &nr);
-		if (sftype == SENSORS_SUBFEATURE_UNKNOWN)
-			continue;
-		ftype = sftype >> 8;
-
-		/* Adjust the channel number */
-		switch (ftype) {
-		case SENSORS_FEATURE_FAN:
-		case SENSORS_FEATURE_TEMP:
-		case SENSORS_FEATURE_POWER:
-		case SENSORS_FEATURE_ENERGY:
-		case SENSORS_FEATURE_CURR:
-		case SENSORS_FEATURE_HUMIDITY:
-			nr--;
-			break;
-		default:
-			break;
-		}
+/* Position of a subfeature in the sparse table of its feature */
+static int sensors_subfeature_offset(sensors_subfeature_type sftype)
+{
+	if ((sftype >> 8) < SENSORS_FEATURE_VID)
+		return ((sftype & 0x80) >> 7) * max_subfeatures +
+		       (sftype & 0x7F);
+	return sftype & 0xFF;
+}
 
-		/* Skip invalid entries. The high limit is arbitrary, we just
-		   don't want to allocate an insane amount of memory. */
-		if (nr < 0 || nr >= 1024) {
-#ifdef DEBUG
-			sensors_fatal_error(__func__,
-					    "Invalid channel number!");
-#endif
-			continue;
-		}
+int sensors_check_subfeature_type(sensors_subfeature_type sftype)
+{
+	sensors_init_feature_size();
+	if ((sftype >> 8) < SENSORS_FEATURE_VID)
+		return (int)(sftype & 0x7F) < max_subfeatures;
+	return (sftype >> 8) < SENSORS_FEATURE_MAX &&
+	       (int)(sftype & 0xFF) < feature_size;
+}
 
-		/* (Re-)allocate memory if needed */
-		if (all_types[ftype].count < nr + 1) {
-			int old_count = all_types[ftype].count;
-			int step = ftype < SENSORS_FEATURE_VID ? 8 :
-				   ftype < SENSORS_FEATURE_BEEP_ENABLE ? 2 : 1;
+void sensors_init_chip_tables(sensors_chip_features *chip)
+{
+	const sensors_feature *feature;
+	int i;
+
+	sensors_init_feature_size();
+
+	chip->attr_fd = sensors_arena_alloc(chip->subfeature_count *
+					    sizeof(int));
+	chip->retired_fd = sensors_arena_alloc(sizeof(sensors_retired_fd *));
+	*chip->retired_fd = NULL;
+	chip->label = sensors_arena_alloc(chip->feature_count *
+					  sizeof(char *));
+	chip->subfeature_slot = sensors_arena_alloc(chip->feature_count *
+						    feature_size *
+						    sizeof(unsigned short));
+	chip->slot_count = feature_size;
+	for (i = 0; i < chip->subfeature_count; i++)
+		chip->attr_fd[i] = -1;
+	/* See sensors_bind_config() */
+	chip->next_visible = NULL;
+	chip->compute = NULL;
+
+	/* Keep the position of each subfeature in the sparse table, so
+	   that sensors_get_subfeature() can find it directly */
+	for (i = 0; i < chip->subfeature_count; i++) {
+		feature = &chip->feature[chip->subfeature[i].mapping];
+		chip->subfeature_slot[feature->number * feature_size +
+			sensors_subfeature_offset(chip->subfeature[i].type)] =
+			i - feature->first_subfeature + 1;
+	}
+}
 
-			while (all_types[ftype].count < nr + 1)
-				all_types[ftype].count += step;
+/* An attribute found in the device directory */
+struct sensors_dyn_attr {
+	int nr;		/* Channel number */
+	int seq;	/* Position in the directory */
+	sensors_subfeature sf;
+};
 
-			all_types[ftype].sf = realloc(all_types[ftype].sf,
-						all_types[ftype].count *
-						feature_size *
-						sizeof(sensors_subfeature));
-			if (!all_types[ftype].sf)
-				sensors_fatal_error(__func__, "Out of memory");
-			memset(all_types[ftype].sf + old_count * feature_size,
-			       0, (all_types[ftype].count - old_count) *
-				  feature_size * sizeof(sensors_subfeature));
-		}
+static int sensors_dyn_attr_same_feature(const struct sensors_dyn_attr *a,
+					 const struct sensors_dyn_attr *b)
+{
+	return (a->sf.type >> 8) == (b->sf.type >> 8) && a->nr == b->nr;
+}
 
-		/* "calculate" a place to store the subfeature in our sparse,
-		   sorted table */
-		if (ftype < SENSORS_FEATURE_VID)
-			i = nr * feature_size +
-			    ((sftype & 0x80) >> 7) * max_subfeatures +
-			    (sftype & 0x7F);
-		else
-			i = nr * feature_size + (sftype & 0xFF);
+/* Order of the features and subfeatures of a chip: by feature type, then
+   channel number, then subfeature type. Of duplicate attributes, the first
+   one found is kept. */
+static int sensors_dyn_attr_cmp(const void *a, const void *b)
+{
+	const struct sensors_dyn_attr *x = a, *y = b;
+
+	if ((x->sf.type >> 8) != (y->sf.type >> 8))
+		return (x->sf.type >> 8) < (y->sf.type >> 8) ? -1 : 1;
+	if (x->nr != y->nr)
+		return x->nr < y->nr ? -1 : 1;
+	if (x->sf.type != y->sf.type)
+		return x->sf.type < y->sf.type ? -1 : 1;
+	return x->seq - y->seq;
+}
 
-		if (all_types[ftype].sf[i].name) {
-#ifdef DEBUG
-			sensors_fatal_error(__func__, "Duplicate subfeature");
-#endif
-			continue;
-		}
+static int sensors_read_dynamic_chip(sensors_chip_features *chip,
+				     const char *dev_path)
+{
+	int i, fnum, sfnum, count = 0, max = 0;
+	DIR *dir;
+	struct dirent *ent;
+	struct sensors_dyn_attr attr, *attrs = NULL;
+	sensors_subfeature *dyn_subfeatures;
+	sensors_feature *dyn_features;
+	sensors_subfeature_type sftype;
 
-		/* fill in the subfeature members */
-		all_types[ftype].sf[i].type = sftype;
-		all_types[ftype].sf[i].name = strdup(name);
-		if (!all_types[ftype].sf[i].name)
-			sensors_fatal_error(__func__, "Out of memory");
+	if (!(dir = opendir(dev_path)))
+		return -errno;
 
-		/* Other and misc subfeatures are never scaled */
-		if (sftype < SENSORS_SUBFEATURE_VID && !(sftype & 0x80))
-			all_types[ftype].sf[i].flags |= SENSORS_COMPUTE_MAPPING;
-		all_types[ftype].sf[i].flags |=
-					sensors_get_attr_mode(dev_path, name);
+	/* Collect the attributes in the order of the directory, then sort
+	   them once, so that the dense tables can be filled directly */
+	memset(&attr, 0, sizeof(attr));
+	while ((ent = readdir(dir))) {
+		sftype = sensors_get_attr_type(ent, &attr.nr);
+		if (sftype == SENSORS_SUBFEATURE_UNKNOWN)
+			continue;
 
-		sfnum++;
+		attr.seq = count;
+		attr.sf.type = sftype;
+		attr.sf.name = sensors_intern(ent->d_name);
+		sensors_add_array_el(&attr, &attrs, &count, &max,
+				     sizeof(attr));
 	}
-	closedir(dir);
 
-	if (!sfnum) { /* No subfeature */
+	if (!count) { /* No subfeature */
 		chip->subfeature = NULL;
-		goto exit_free;
+		goto exit_close;
 	}
 
-	/* How many main features? */
-	for (ftype = 0; ftype < SENSORS_FEATURE_MAX; ftype++) {
-		prev_slot = -1;
-		for (i = 0; i < all_types[ftype].count * feature_size; i++) {
-			if (!all_types[ftype].sf[i].name)
-				continue;
+	qsort(attrs, count, sizeof(*attrs), sensors_dyn_attr_cmp);
 
-			if (i / feature_size != prev_slot) {
-				fnum++;
-				prev_slot = i / feature_size;
-			}
+	/* Drop duplicates, and count the main features */
+	sfnum = fnum = 0;
+	for (i = 0; i < count; i++) {
+		if (sfnum && attrs[sfnum - 1].sf.type == attrs[i].sf.type &&
+		    attrs[sfnum - 1].nr == attrs[i].nr) {
+#ifdef DEBUG
+			sensors_fatal_error(__func__, "Duplicate subfeature");
+#endif
+			continue;
 		}
+		if (!sfnum ||
+		    !sensors_dyn_attr_same_feature(&attrs[sfnum - 1], &attrs[i]))
+			fnum++;
+		attrs[sfnum++] = attrs[i];
 	}
 
-	dyn_subfeatures = calloc(sfnum, sizeof(sensors_subfeature));
-	dyn_features = calloc(fnum, sizeof(sensors_feature));
-	if (!dyn_subfeatures || !dyn_features)
-		sensors_fatal_error(__func__, "Out of memory");
+	dyn_subfeatures = sensors_arena_alloc(sfnum *
+					      sizeof(sensors_subfeature));
+	dyn_features = sensors_arena_alloc(fnum * sizeof(sensors_feature));
 
-	/* Copy from the sparse array to the compact array */
-	sfnum = 0;
 	fnum = -1;
-	for (ftype = 0; ftype < SENSORS_FEATURE_MAX; ftype++) {
-		prev_slot = -1;
-		for (i = 0; i < all_types[ftype].count * feature_size; i++) {
-			if (!all_types[ftype].sf[i].name)
-				continue;
-
-			/* New main feature? */
-			if (i / feature_size != prev_slot) {
-				fnum++;
-				prev_slot = i / feature_size;
-
-				dyn_features[fnum].name =
-					get_feature_name(ftype,
-						all_types[ftype].sf[i].name);
-				dyn_features[fnum].number = fnum;
-				dyn_features[fnum].first_subfeature = sfnum;
-				dyn_features[fnum].type = ftype;
-			}
+	for (i = 0; i < sfnum; i++) {
+		/* New main feature? */
+		if (!i || !sensors_dyn_attr_same_feature(&attrs[i - 1],
+							 &attrs[i])) {
+			fnum++;
+			dyn_features[fnum].name =
+				get_feature_name(attrs[i].sf.type >> 8,
+						 attrs[i].sf.name);
+			dyn_features[fnum].number = fnum;
+			dyn_features[fnum].first_subfeature = i;
+			dyn_features[fnum].type = attrs[i].sf.type >> 8;
+		}
 
-			dyn_subfeatures[sfnum] = all_types[ftype].sf[i];
-			dyn_subfeatures[sfnum].number = sfnum;
-			/* Back to the feature */
-			dyn_subfeatures[sfnum].mapping = fnum;
+		dyn_subfeatures[i] = attrs[i].sf;
+		dyn_subfeatures[i].number = i;
+		/* Back to the feature */
+		dyn_subfeatures[i].mapping = fnum;
 
-			sfnum++;
-		}
+		/* Other and misc subfeatures are never scaled */
+		sftype = attrs[i].sf.type;
+		if (sftype < SENSORS_SUBFEATURE_VID && !(sftype & 0x80))
+			dyn_subfeatures[i].flags |= SENSORS_COMPUTE_MAPPING;
+		dyn_subfeatures[i].flags |=
+			sensors_get_attr_mode(dirfd(dir), attrs[i].sf.name);
 	}
 
 	chip->subfeature = dyn_subfeatures;
@@ -596,9 +782,21 @@ static int sensors_read_dynamic_chip(sensors_chip_features *chip,
 	chip->feature = dyn_features;
 	chip->feature_count = ++fnum;
 
-exit_free:
-	for (ftype = 0; ftype < SENSORS_FEATURE_MAX; ftype++)
-		free(all_types[ftype].sf);
+	sensors_init_chip_tables(chip);
+
+exit_close:
+	closedir(dir);
+	free(attrs);
+	return 0;
+}
+
+int sensors_read_sysfs_chip_features(sensors_chip_features *chip)
+{
+	int err;
+
+	err = sensors_read_dynamic_chip(chip, chip->chip.path);
+	if (err < 0)
+		return -SENSORS_ERR_KERNEL;
 	return 0;
 }
 
@@ -753,66 +951,108 @@ static int find_bus_type(const char *dev_path,
 	return ret;
 }
 
-/* returns: number of devices added (0 or 1) if successful, <0 otherwise */
+/* Chips to keep, see sensors_read_sysfs_chips() */
+static const sensors_chip_name *sysfs_match;
+static int sysfs_match_count;
+
+/* Returns 1 if the chip name matches the filter, 0 if not */
+static int sysfs_match_filter(const sensors_chip_name *name)
+{
+	int i;
+
+	if (!sysfs_match)
+		return 1;
+	for (i = 0; i < sysfs_match_count; i++)
+		if (sensors_match_chip(name, &sysfs_match[i]))
+			return 1;
+	return 0;
+}
+
+/* Read the chip name, bus and path of a hwmon device into entry.
+   returns: 1 if a chip was found (entry->chip.prefix is then set) or
+   filtered out, 0 if this isn't a chip, <0 otherwise */
 static int sensors_read_one_sysfs_chip(const char *dev_path,
 				       const char *dev_name,
-				       const char *hwmon_path)
+				       const char *hwmon_path,
+				       sensors_chip_features *entry)
 {
-	int ret = 1;
+	int ret = 1, err;
 	int virtual = 0;
-	sensors_chip_features entry;
+	char *name;
+
+	/* The features are discovered later, when first needed */
+	memset(entry, 0, sizeof(*entry));
 
 	/* ignore any device without name attribute */
-	if (!(entry.chip.prefix = sysfs_read_attr(hwmon_path, "name")))
+	if (!(name = sysfs_read_attr(hwmon_path, "name")))
 		return 0;
+	entry->chip.prefix = sensors_intern(name);
+	free(name);
+
+	/* Filtered out chips are reported as found, so that the device
+	   itself isn't tried as a fallback. Try the prefix alone first,
+	   before resolving the bus. */
+	entry->chip.bus.type = SENSORS_BUS_TYPE_ANY;
+	entry->chip.bus.nr = SENSORS_BUS_NR_ANY;
+	entry->chip.addr = SENSORS_CHIP_NAME_ADDR_ANY;
+	if (!sysfs_match_filter(&entry->chip)) {
+		entry->chip.prefix = NULL;
+		return 1;
+	}
 
-	entry.chip.path = strdup(hwmon_path);
-	if (!entry.chip.path)
-		sensors_fatal_error(__func__, "Out of memory");
+	/* Interned, so that a device which comes back doesn't take more
+	   memory */
+	entry->chip.path = sensors_intern(hwmon_path);
 
 	if (dev_path == NULL) {
 		virtual = 1;
 	} else {
-		ret = find_bus_type(dev_path, dev_name, &entry);
+		ret = find_bus_type(dev_path, dev_name, entry);
 		if (ret == 0) {
 			virtual = 1;
 			ret = 1;
 		} else if (ret < 0) {
-			goto exit_free;
+			goto exit_discard;
 		}
 	}
 	if (virtual) {
 		/* Virtual device */
-		entry.chip.bus.type = SENSORS_BUS_TYPE_VIRTUAL;
-		entry.chip.bus.nr = 0;
+		entry->chip.bus.type = SENSORS_BUS_TYPE_VIRTUAL;
+		entry->chip.bus.nr = 0;
 		/* For now we assume that virtual devices are unique */
-		entry.chip.addr = 0;
+		entry->chip.addr = 0;
 	}
 
-	if (sensors_read_dynamic_chip(&entry, hwmon_path) < 0) {
+	if (!sysfs_match_filter(&entry->chip))
+		goto exit_discard;
+
+	err = sensors_has_attrs(hwmon_path);
+	if (err < 0) {
 		ret = -SENSORS_ERR_KERNEL;
-		goto exit_free;
+		goto exit_discard;
 	}
-	if (!entry.subfeature) { /* No subfeature, discard chip */
+	if (!err) { /* No subfeature, discard chip */
 		ret = 0;
-		goto exit_free;
+		goto exit_discard;
 	}
-	sensors_add_proc_chips(&entry);
 
 	return ret;
 
-exit_free:
-	free(entry.chip.prefix);
-	free(entry.chip.path);
+exit_discard:
+	/* Left in the arena */
+	entry->chip.prefix = NULL;
 	return ret;
 }
 
 static int sensors_add_hwmon_device_compat(const char *path,
 					   const char *dev_name)
 {
+	sensors_chip_features entry;
 	int err;
 
-	err = sensors_read_one_sysfs_chip(path, dev_name, path);
+	err = sensors_read_one_sysfs_chip(path, dev_name, path, &entry);
+	if (entry.chip.prefix)
+		sensors_add_proc_chips(&entry);
 	if (err < 0)
 		return err;
 	return 0;
@@ -830,12 +1070,16 @@ static int sensors_read_sysfs_chips_compat(void)
 	return 0;
 }
 
-static int sensors_add_hwmon_device(const char *path, const char *classdev)
+/* Read the chip of a hwmon class device into entry. If no chip was found,
+   entry->chip.prefix is NULL. Returns 0 on success, <0 on error. */
+static int sensors_read_hwmon_device(const char *path,
+				     sensors_chip_features *entry)
 {
 	char linkpath[NAME_MAX];
 	char *dev_path, *dev_name;
 	int err = 0;
-	(void)classdev; /* hide warning */
+
+	entry->chip.prefix = NULL;
 
 	snprintf(linkpath, NAME_MAX, "%s/device", path);
 	dev_path = realpath(linkpath, NULL);
@@ -844,17 +1088,19 @@ static int sensors_add_hwmon_device(const char *path, const char *classdev)
 			sensors_fatal_error(__func__, "Out of memory");
 		} else {
 			/* No device link? Treat as virtual */
-			err = sensors_read_one_sysfs_chip(NULL, NULL, path);
+			err = sensors_read_one_sysfs_chip(NULL, NULL, path,
+							  entry);
 		}
 	} else {
 		dev_name = strrchr(dev_path, '/') + 1;
 
 		/* The attributes we want might be those of the hwmon class
 		   device, or those of the device itself. */
-		err = sensors_read_one_sysfs_chip(dev_path, dev_name, path);
+		err = sensors_read_one_sysfs_chip(dev_path, dev_name, path,
+						  entry);
 		if (err == 0)
 			err = sensors_read_one_sysfs_chip(dev_path, dev_name,
-							  dev_path);
+							  dev_path, entry);
 		free(dev_path);
 	}
 	if (err < 0)
@@ -862,22 +1108,152 @@ static int sensors_add_hwmon_device(const char *path, const char *classdev)
 	return 0;
 }
 
+static int sensors_add_hwmon_device(const char *path, const char *classdev)
+{
+	sensors_chip_features entry;
+	int err;
+	(void)classdev; /* hide warning */
+
+	err = sensors_read_hwmon_device(path, &entry);
+	if (entry.chip.prefix)
+		sensors_add_proc_chips(&entry);
+	return err;
+}
+
+/* Parallel enumeration of the hwmon class devices: the devices are
+   listed first, then read by a pool of threads, each into its own slot,
+   and finally added in the order in which they were listed, so that the
+   result is the same as sysfs_foreach_classdev() would give. */
+struct hwmon_job {
+	char *path;
+	sensors_chip_features entry;
+	int err;
+};
+
+struct hwmon_pool {
+	sensors_context *ctx;	/* Of the calling thread */
+	struct hwmon_job *jobs;
+	int count;
+	int next;		/* Next job to pick, atomic */
+};
+
+static void sensors_hwmon_worker(struct hwmon_pool *pool)
+{
+	struct hwmon_job *job;
+	int i;
+
+	while ((i = __sync_fetch_and_add(&pool->next, 1)) < pool->count) {
+		job = &pool->jobs[i];
+		job->err = sensors_read_hwmon_device(job->path, &job->entry);
+	}
+}
+
+/* The other workers work on the context of the calling thread. Only
+   their own context is set: the calling thread must keep following the
+   published context. */
+static void *sensors_hwmon_thread(void *data)
+{
+	struct hwmon_pool *pool = data;
+
+	sensors_current_context = pool->ctx;
+	sensors_hwmon_worker(pool);
+	return NULL;
+}
+
+/* Same as sysfs_foreach_classdev("hwmon", sensors_add_hwmon_device), with
+   up to threads threads */
+static int sensors_read_hwmon_parallel(int threads)
+{
+	char path[PATH_MAX];
+	struct hwmon_pool pool;
+	struct hwmon_job job;
+	pthread_t *tids;
+	int i, max = 0, started, ret = 0;
+	DIR *dir;
+	struct dirent *ent;
+
+	snprintf(path, PATH_MAX, "%s/class/hwmon", sensors_sysfs_mount);
+	if (!(dir = opendir(path)))
+		return errno;
+
+	pool.ctx = sensors_this_context();
+	pool.jobs = NULL;
+	pool.count = 0;
+	pool.next = 0;
+	memset(&job, 0, sizeof(job));
+	while ((ent = readdir(dir))) {
+		if (ent->d_name[0] == '.')	/* skip hidden entries */
+			continue;
+
+		job.path = malloc(strlen(path) + 1 + strlen(ent->d_name) + 1);
+		if (!job.path)
+			sensors_fatal_error(__func__, "Out of memory");
+		sprintf(job.path, "%s/%s", path, ent->d_name);
+		sensors_add_array_el(&job, &pool.jobs, &pool.count, &max,
+				     sizeof(struct hwmon_job));
+	}
+	closedir(dir);
+
+	/* The calling thread is one of the workers */
+	if (threads > pool.count)
+		threads = pool.count;
+	tids = malloc(threads * sizeof(pthread_t));
+	if (threads && !tids)
+		sensors_fatal_error(__func__, "Out of memory");
+	for (started = 0; started < threads - 1; started++)
+		if (pthread_create(&tids[started], NULL, sensors_hwmon_thread,
+				   &pool))
+			break;	/* Do with the threads we have */
+	sensors_hwmon_worker(&pool);
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+	free(tids);
+
+	for (i = 0; i < pool.count; i++) {
+		if (!ret && pool.jobs[i].err < 0)
+			ret = pool.jobs[i].err;
+		/* Stop at the first error, as the serial code does */
+		if (pool.jobs[i].entry.chip.prefix && !ret)
+			sensors_add_proc_chips(&pool.jobs[i].entry);
+		free(pool.jobs[i].path);
+	}
+	free(pool.jobs);
+
+	return ret;
+}
+
 /* returns 0 if successful, !0 otherwise */
-int sensors_read_sysfs_chips(void)
+int sensors_read_sysfs_chips(const sensors_chip_name *match, int count)
 {
 	int ret;
 
-	ret = sysfs_foreach_classdev("hwmon", sensors_add_hwmon_device);
+	sysfs_match = match;
+	sysfs_match_count = count;
+
+	if (sensors_opt_init_threads > 1)
+		ret = sensors_read_hwmon_parallel(sensors_opt_init_threads);
+	else
+		ret = sysfs_foreach_classdev("hwmon",
+					     sensors_add_hwmon_device);
 	if (ret == ENOENT) {
 		/* compatibility function for kernel 2.6.n where n <= 13 */
-		return sensors_read_sysfs_chips_compat();
+		ret = sensors_read_sysfs_chips_compat();
 	}
 
+	sysfs_match = NULL;
+
 	if (ret > 0)
 		ret = -SENSORS_ERR_KERNEL;
+	if (ret == 0)
+		sensors_index_proc_chips();
 	return ret;
 }
 
+int sensors_read_sysfs_chip(const char *path, sensors_chip_features *entry)
+{
+	return sensors_read_hwmon_device(path, entry);
+}
+
 /* returns 0 if successful, !0 otherwise */
 static int sensors_add_i2c_bus(const char *path, const char *classdev)
 {
@@ -914,14 +1290,152 @@ int sensors_read_sysfs_bus(void)
 	return 0;
 }
 
-int sensors_read_sysfs_attr(const sensors_chip_name *name,
+/* Marks the cached descriptor of an attribute which went away, see
+   sysfs_drop_attr_fd() */
+#define SYSFS_FD_GONE	-2
+
+/*
+ * Return the cached file descriptor of a subfeature attribute, opening it
+ * first if needed. Returns -1 if the attribute can't be opened, and
+ * SYSFS_FD_GONE if it went away.
+ */
+static int sysfs_get_attr_fd(const sensors_chip_features *chip,
+			     const sensors_subfeature *subfeature)
+{
+	char n[NAME_MAX];
+	int fd;
+
+	/* Read sets may still point to the subfeatures the chip had before
+	   its device came back, see hotplug.c */
+	if (subfeature->number >= chip->subfeature_count ||
+	    subfeature != &chip->subfeature[subfeature->number])
+		return SYSFS_FD_GONE;
+
+	fd = chip->attr_fd[subfeature->number];
+	if (fd >= 0 || fd == SYSFS_FD_GONE)
+		return fd;
+
+	snprintf(n, NAME_MAX, "%s/%s", chip->chip.path, subfeature->name);
+	fd = open(n, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	/* Another thread may have cached a descriptor in the meantime */
+	if (!__sync_bool_compare_and_swap(&chip->attr_fd[subfeature->number],
+					  -1, fd)) {
+		close(fd);
+		fd = chip->attr_fd[subfeature->number];
+	}
+	return fd;
+}
+
+/*
+ * Forget about a cached file descriptor, e.g. because the device is gone.
+ * Other threads may still be reading it, and would read another file if
+ * its number got reused, so it is only closed along with the chip. The
+ * attribute isn't opened again until then, so that an attribute which
+ * keeps failing doesn't leak a descriptor at every read.
+ */
+static void sysfs_drop_attr_fd(const sensors_chip_features *chip, int nr,
+			       int fd)
+{
+	sensors_retired_fd *retired;
+
+	if (!__sync_bool_compare_and_swap(&chip->attr_fd[nr], fd,
+					  SYSFS_FD_GONE))
+		return;
+
+	retired = malloc(sizeof(sensors_retired_fd));
+	if (!retired)
+		sensors_fatal_error(__func__, "Out of memory");
+	retired->fd = fd;
+	do {
+		retired->next = *chip->retired_fd;
+	} while (!__sync_bool_compare_and_swap(chip->retired_fd, retired->next,
+					       retired));
+}
+
+void sensors_close_attr_fds(sensors_chip_features *chip)
+{
+	sensors_retired_fd *retired;
+	int i;
+
+	for (i = 0; chip->attr_fd && i < chip->subfeature_count; i++) {
+		if (chip->attr_fd[i] >= 0)
+			close(chip->attr_fd[i]);
+		chip->attr_fd[i] = -1;
+	}
+	while (chip->retired_fd && (retired = *chip->retired_fd)) {
+		*chip->retired_fd = retired->next;
+		close(retired->fd);
+		free(retired);
+	}
+}
+
+/* Convert the raw contents of an attribute file to a value */
+static int sysfs_parse_attr(const sensors_subfeature *subfeature,
+			    char *buf, ssize_t len, double *value)
+{
+	char *endp;
+
+	buf[len] = '\0';
+	*value = strtod(buf, &endp);
+	if (endp == buf)
+		return -SENSORS_ERR_ACCESS_R;
+	*value /= get_type_scaling(subfeature->type);
+
+	return 0;
+}
+
+/* Convert a failed read to an error value */
+static int sysfs_read_error(const sensors_chip_features *chip,
+			    const sensors_subfeature *subfeature,
+			    int fd, int err)
+{
+	if (err == ENODEV || err == ENOENT)
+		sysfs_drop_attr_fd(chip, subfeature->number, fd);
+	if (err == EIO)
+		return -SENSORS_ERR_IO;
+	return -SENSORS_ERR_ACCESS_R;
+}
+
+/*
+ * Read a value using a cached file descriptor. Using pread() at offset 0
+ * makes sysfs generate fresh contents, so we don't need to reopen the
+ * attribute file for every read.
+ */
+static int sysfs_read_attr_cached(const sensors_chip_features *chip,
+				  const sensors_subfeature *subfeature,
+				  double *value)
+{
+	char buf[ATTR_MAX];
+	ssize_t len;
+	int fd;
+
+	fd = sysfs_get_attr_fd(chip, subfeature);
+	if (fd == SYSFS_FD_GONE)
+		return -SENSORS_ERR_ACCESS_R;
+	if (fd < 0)
+		return -SENSORS_ERR_KERNEL;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len < 0)
+		return sysfs_read_error(chip, subfeature, fd, errno);
+
+	return sysfs_parse_attr(subfeature, buf, len, value);
+}
+
+int sensors_read_sysfs_attr(const sensors_chip_features *chip,
 			    const sensors_subfeature *subfeature,
 			    double *value)
 {
 	char n[NAME_MAX];
 	FILE *f;
 
-	snprintf(n, NAME_MAX, "%s/%s", name->path, subfeature->name);
+	if (sensors_opt_cache_fds)
+		return sysfs_read_attr_cached(chip, subfeature, value);
+
+	snprintf(n, NAME_MAX, "%s/%s", chip->chip.path, subfeature->name);
 	if ((f = fopen(n, "r"))) {
 		int res, err = 0;
 
@@ -980,3 +1494,193 @@ int sensors_write_sysfs_attr(const sensors_chip_name *name,
 
 	return 0;
 }
+
+/*
+ * Batches of attributes, read all at once. If libsensors was built with
+ * io_uring support, all the reads of a batch are submitted together, so
+ * that a slow device (typically on I2C) doesn't delay the others. Otherwise,
+ * or if io_uring is not available at run time, attributes are read one
+ * after the other with pread(). Either way, batches use cached file
+ * descriptors.
+ */
+
+#define BATCH_RING_MAX	256	/* Max number of reads in flight */
+
+struct sensors_sysfs_batch {
+	const sensors_sysfs_attr *attrs;
+	int count;
+#ifdef HAVE_LIBURING
+	int has_ring;
+	struct io_uring ring;
+	char (*buf)[ATTR_MAX];
+	int *fd;		/* The descriptor each read was submitted with */
+#endif
+};
+
+sensors_sysfs_batch *sensors_sysfs_batch_new(const sensors_sysfs_attr *attrs,
+					     int count)
+{
+	sensors_sysfs_batch *batch;
+
+	batch = malloc(sizeof(sensors_sysfs_batch));
+	if (!batch)
+		sensors_fatal_error(__func__, "Out of memory");
+	batch->attrs = attrs;
+	batch->count = count;
+
+#ifdef HAVE_LIBURING
+	batch->has_ring = 0;
+	if (count < 2)
+		return batch;
+	if (io_uring_queue_init(count < BATCH_RING_MAX ? count : BATCH_RING_MAX,
+				&batch->ring, 0) < 0)
+		return batch;	/* Fall back to pread() */
+
+	batch->buf = malloc(count * sizeof(*batch->buf));
+	batch->fd = malloc(count * sizeof(int));
+	if (!batch->buf || !batch->fd)
+		sensors_fatal_error(__func__, "Out of memory");
+	batch->has_ring = 1;
+#endif
+
+	return batch;
+}
+
+#ifdef HAVE_LIBURING
+/* Wait for the count reads in flight to complete, and discard them.
+   Returns 0 once none is left, <0 if some may still be in flight. */
+static int sysfs_batch_reap(sensors_sysfs_batch *batch, int count)
+{
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	while (count) {
+		ret = io_uring_wait_cqe(&batch->ring, &cqe);
+		if (ret == -EINTR)
+			continue;
+		if (ret < 0)
+			return ret;
+		io_uring_cqe_seen(&batch->ring, cqe);
+		count--;
+	}
+	return 0;
+}
+
+/* Stop using the ring, after count reads in flight completed. If they
+   can't be waited for, the kernel may still write to the buffers, which
+   are then leaked rather than freed. */
+static void sysfs_batch_exit(sensors_sysfs_batch *batch, int count)
+{
+	int ret = sysfs_batch_reap(batch, count);
+
+	io_uring_queue_exit(&batch->ring);
+	if (!ret)
+		free(batch->buf);
+	free(batch->fd);
+	batch->has_ring = 0;
+}
+#endif
+
+void sensors_sysfs_batch_free(sensors_sysfs_batch *batch)
+{
+	if (!batch)
+		return;
+#ifdef HAVE_LIBURING
+	if (batch->has_ring)
+		sysfs_batch_exit(batch, 0);
+#endif
+	free(batch);
+}
+
+#ifdef HAVE_LIBURING
+/* Submit up to BATCH_RING_MAX reads starting at attrs[first], and reap
+   their completions. Returns the number of attributes processed, or <0
+   if the ring failed, in which case the reads still in flight were
+   stored in *inflight and no result should be used. */
+static int sysfs_batch_uring(sensors_sysfs_batch *batch, int first,
+			     double *values, int *errors, int *inflight)
+{
+	const sensors_sysfs_attr *attr;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int i, fd, nr, ret, queued = 0;
+
+	*inflight = 0;
+	for (i = first; i < batch->count && queued < BATCH_RING_MAX; i++) {
+		attr = &batch->attrs[i];
+		fd = sysfs_get_attr_fd(attr->chip, attr->subfeature);
+		if (fd < 0) {
+			errors[i] = fd == SYSFS_FD_GONE ?
+				    -SENSORS_ERR_ACCESS_R : -SENSORS_ERR_KERNEL;
+			continue;
+		}
+
+		sqe = io_uring_get_sqe(&batch->ring);
+		if (!sqe)
+			break;
+		io_uring_prep_read(sqe, fd, batch->buf[i], ATTR_MAX - 1, 0);
+		io_uring_sqe_set_data(sqe, (void *)(long)i);
+		batch->fd[i] = fd;
+		queued++;
+	}
+
+	ret = io_uring_submit_and_wait(&batch->ring, queued);
+	if (ret < queued) {
+		/* Those which were submitted must complete all the same */
+		*inflight = ret > 0 ? ret : 0;
+		return ret < 0 ? ret : -EIO;
+	}
+
+	while (queued) {
+		ret = io_uring_wait_cqe(&batch->ring, &cqe);
+		if (ret == -EINTR)
+			continue;
+		if (ret < 0) {
+			*inflight = queued;
+			return ret;
+		}
+		nr = (long)io_uring_cqe_get_data(cqe);
+		attr = &batch->attrs[nr];
+
+		if (cqe->res < 0)
+			errors[nr] = sysfs_read_error(attr->chip,
+						      attr->subfeature,
+						      batch->fd[nr], -cqe->res);
+		else
+			errors[nr] = sysfs_parse_attr(attr->subfeature,
+						      batch->buf[nr], cqe->res,
+						      &values[nr]);
+		io_uring_cqe_seen(&batch->ring, cqe);
+		queued--;
+	}
+
+	return i - first;
+}
+#endif
+
+int sensors_read_sysfs_batch(sensors_sysfs_batch *batch, double *values,
+			     int *errors)
+{
+	int i = 0;
+
+#ifdef HAVE_LIBURING
+	while (batch->has_ring && i < batch->count) {
+		int inflight, ret;
+
+		ret = sysfs_batch_uring(batch, i, values, errors, &inflight);
+		if (ret < 0) {
+			/* Don't try again, finish with pread() */
+			sysfs_batch_exit(batch, inflight);
+			break;
+		}
+		i += ret;
+	}
+#endif
+
+	for (; i < batch->count; i++)
+		errors[i] = sysfs_read_attr_cached(batch->attrs[i].chip,
+						   batch->attrs[i].subfeature,
+						   &values[i]);
+
+	return 0;
+}
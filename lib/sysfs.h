@@ -26,12 +26,40 @@ extern char sensors_sysfs_mount[];
 
 int sensors_init_sysfs(void);
 
-int sensors_read_sysfs_chips(void);
+/* Enumerate the chips. If match is not NULL, only the chips matching at
+   least one of the count names it points to are kept. */
+int sensors_read_sysfs_chips(const sensors_chip_name *match, int count);
 
 int sensors_read_sysfs_bus(void);
 
+/* Read the chip of a single hwmon class device, given its path, the way
+   sensors_read_sysfs_chips() does. If no chip was found, entry->chip.prefix
+   is NULL. Returns 0 on success, <0 on error. */
+int sensors_read_sysfs_chip(const char *path, sensors_chip_features *entry);
+
+/* Discover the features and subfeatures of a chip found by
+   sensors_read_sysfs_chips(). On error, the chip is left without any
+   subfeature. */
+int sensors_read_sysfs_chip_features(sensors_chip_features *chip);
+
+/* Allocate the tables of a chip which go along with its features and
+   subfeatures, once these are set */
+void sensors_init_chip_tables(sensors_chip_features *chip);
+
+/* Returns 1 if sftype fits in the tables set by sensors_init_chip_tables(),
+   0 otherwise */
+int sensors_check_subfeature_type(sensors_subfeature_type sftype);
+
+/* Return the subfeature type and channel number based on the name of a
+   sysfs attribute, SENSORS_SUBFEATURE_UNKNOWN if it isn't one */
+sensors_subfeature_type sensors_subfeature_get_type(const char *name, int *nr);
+
+/* Close all the file descriptors of a chip, cached or dropped. No other
+   thread may be using the chip. */
+void sensors_close_attr_fds(sensors_chip_features *chip);
+
 /* Read a value out of a sysfs attribute file */
-int sensors_read_sysfs_attr(const sensors_chip_name *name,
+int sensors_read_sysfs_attr(const sensors_chip_features *chip,
 			    const sensors_subfeature *subfeature,
 			    double *value);
 
@@ -40,4 +68,24 @@ int sensors_write_sysfs_attr(const sensors_chip_name *name,
 			     const sensors_subfeature *subfeature,
 			     double value);
 
+/* An attribute to read as part of a batch */
+typedef struct sensors_sysfs_attr {
+	const sensors_chip_features *chip;
+	const sensors_subfeature *subfeature;
+} sensors_sysfs_attr;
+
+typedef struct sensors_sysfs_batch sensors_sysfs_batch;
+
+/* Prepare a batch of attributes to be read together. The attrs array must
+   remain valid until the batch is freed. */
+sensors_sysfs_batch *sensors_sysfs_batch_new(const sensors_sysfs_attr *attrs,
+					     int count);
+
+void sensors_sysfs_batch_free(sensors_sysfs_batch *batch);
+
+/* Read all the attributes of a batch. The result of each read is stored in
+   errors, 0 on success and <0 on failure. */
+int sensors_read_sysfs_batch(sensors_sysfs_batch *batch, double *values,
+			     int *errors);
+
 #endif /* def LIB_SENSORS_SYSFS_H */
@@ -1,8 +1,25 @@
 LIB_DIR		:= lib
 LIB_TEST_DIR	:= lib/test
 
-LIB_TEST_TARGETS := $(LIB_TEST_DIR)/test-scanner
-LIB_TEST_SOURCES := $(LIB_TEST_DIR)/test-scanner.c
+LIB_TEST_TARGETS := $(LIB_TEST_DIR)/test-scanner \
+		    $(LIB_TEST_DIR)/test-fold \
+		    $(LIB_TEST_DIR)/test-classify \
+		    $(LIB_TEST_DIR)/test-hotplug \
+		    $(LIB_TEST_DIR)/test-context \
+		    $(LIB_TEST_DIR)/test-alarm \
+		    $(LIB_TEST_DIR)/test-sampler \
+		    $(LIB_TEST_DIR)/test-stream \
+		    $(LIB_TEST_DIR)/bench-lookup
+LIB_TEST_SOURCES := $(LIB_TEST_DIR)/test-scanner.c \
+		    $(LIB_TEST_DIR)/test-fold.c \
+		    $(LIB_TEST_DIR)/test-classify.c \
+		    $(LIB_TEST_DIR)/test-hotplug.c \
+		    $(LIB_TEST_DIR)/test-context.c \
+		    $(LIB_TEST_DIR)/test-alarm.c \
+		    $(LIB_TEST_DIR)/test-sampler.c \
+		    $(LIB_TEST_DIR)/test-stream.c \
+		    $(LIB_TEST_DIR)/bench-lookup.c \
+		    $(LIB_TEST_DIR)/fakesys.c
 
 LIB_TEST_SCANNER_OBJS := \
 	$(LIB_TEST_DIR)/test-scanner.ro \
@@ -13,10 +30,82 @@ LIB_TEST_SCANNER_OBJS := \
 $(LIB_TEST_DIR)/test-scanner: $(LIB_TEST_SCANNER_OBJS)
 	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_SCANNER_OBJS) -Llib
 
+LIB_TEST_FOLD_OBJS := \
+	$(LIB_TEST_DIR)/test-fold.ro \
+	$(LIBSTOBJECTS)
+
+$(LIB_TEST_DIR)/test-fold: $(LIB_TEST_FOLD_OBJS)
+	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_FOLD_OBJS) $(LIBLDLIBS) -lm
+
+# Same as expr.c, the reference evaluation must not be fused either
+$(LIB_TEST_DIR)/test-fold.ro: PROGCFLAGS += -ffp-contract=off
+
+LIB_TEST_CLASSIFY_OBJS := \
+	$(LIB_TEST_DIR)/test-classify.ro \
+	$(LIBSTOBJECTS)
+
+$(LIB_TEST_DIR)/test-classify: $(LIB_TEST_CLASSIFY_OBJS)
+	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_CLASSIFY_OBJS) $(LIBLDLIBS) -lm
+
+LIB_TEST_HOTPLUG_OBJS := \
+	$(LIB_TEST_DIR)/test-hotplug.ro \
+	$(LIB_TEST_DIR)/fakesys.ro \
+	$(LIBSTOBJECTS)
+
+$(LIB_TEST_DIR)/test-hotplug: $(LIB_TEST_HOTPLUG_OBJS)
+	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_HOTPLUG_OBJS) $(LIBLDLIBS) -lm
+
+LIB_TEST_CONTEXT_OBJS := \
+	$(LIB_TEST_DIR)/test-context.ro \
+	$(LIB_TEST_DIR)/fakesys.ro \
+	$(LIBSTOBJECTS)
+
+$(LIB_TEST_DIR)/test-context: $(LIB_TEST_CONTEXT_OBJS)
+	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_CONTEXT_OBJS) $(LIBLDLIBS) -lm
+
+LIB_TEST_ALARM_OBJS := \
+	$(LIB_TEST_DIR)/test-alarm.ro \
+	$(LIB_TEST_DIR)/fakesys.ro \
+	$(LIBSTOBJECTS)
+
+$(LIB_TEST_DIR)/test-alarm: $(LIB_TEST_ALARM_OBJS)
+	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_ALARM_OBJS) $(LIBLDLIBS) -lm
+
+LIB_TEST_SAMPLER_OBJS := \
+	$(LIB_TEST_DIR)/test-sampler.ro \
+	$(LIB_TEST_DIR)/fakesys.ro \
+	$(LIBSTOBJECTS)
+
+$(LIB_TEST_DIR)/test-sampler: $(LIB_TEST_SAMPLER_OBJS)
+	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_SAMPLER_OBJS) $(LIBLDLIBS) -lm
+
+LIB_TEST_STREAM_OBJS := \
+	$(LIB_TEST_DIR)/test-stream.ro \
+	$(LIBSTOBJECTS)
+
+$(LIB_TEST_DIR)/test-stream: $(LIB_TEST_STREAM_OBJS)
+	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_STREAM_OBJS) $(LIBLDLIBS) -lm
+
+LIB_TEST_BENCH_LOOKUP_OBJS := \
+	$(LIB_TEST_DIR)/bench-lookup.ro \
+	$(LIBSTOBJECTS)
+
+$(LIB_TEST_DIR)/bench-lookup: $(LIB_TEST_BENCH_LOOKUP_OBJS)
+	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_BENCH_LOOKUP_OBJS) $(LIBLDLIBS) -lm
+
 all-lib-test: $(LIB_TEST_TARGETS)
 user :: all-lib-test
 
 $(LIB_TEST_DIR)/test-scanner.ro: $(LIB_DIR)/data.h $(LIB_DIR)/conf.h $(LIB_DIR)/conf-parse.h $(LIB_DIR)/scanner.h
+$(LIB_TEST_DIR)/test-fold.ro: $(LIB_DIR)/data.h $(LIB_DIR)/conf.h $(LIB_DIR)/scanner.h $(LIB_DIR)/expr.h
+$(LIB_TEST_DIR)/test-classify.ro: $(LIB_DIR)/data.h $(LIB_DIR)/sensors.h $(LIB_DIR)/sysfs.h
+$(LIB_TEST_DIR)/test-hotplug.ro: $(LIB_DIR)/data.h $(LIB_DIR)/sensors.h $(LIB_DIR)/hotplug.h $(LIB_TEST_DIR)/fakesys.h
+$(LIB_TEST_DIR)/test-context.ro: $(LIB_DIR)/data.h $(LIB_DIR)/sensors.h $(LIB_TEST_DIR)/fakesys.h
+$(LIB_TEST_DIR)/test-alarm.ro: $(LIB_DIR)/data.h $(LIB_DIR)/sensors.h $(LIB_TEST_DIR)/fakesys.h
+$(LIB_TEST_DIR)/test-sampler.ro: $(LIB_DIR)/data.h $(LIB_DIR)/sensors.h $(LIB_TEST_DIR)/fakesys.h
+$(LIB_TEST_DIR)/test-stream.ro: $(LIB_DIR)/sensors.h
+$(LIB_TEST_DIR)/bench-lookup.ro: $(LIB_DIR)/data.h $(LIB_DIR)/sensors.h
+$(LIB_TEST_DIR)/fakesys.ro: $(LIB_DIR)/data.h $(LIB_DIR)/sensors.h $(LIB_DIR)/sysfs.h $(LIB_DIR)/hotplug.h $(LIB_TEST_DIR)/fakesys.h
 
 clean-lib-test:
 	$(RM) $(LIB_TEST_DIR)/*.rd $(LIB_TEST_DIR)/*.ro 
@@ -0,0 +1,165 @@
+/*
+    bench-lookup.c - Benchmark of the libsensors chip lookup, with and
+                     without the chip name hash index.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../sensors.h"
+#include "../data.h"
+#include "../arena.h"
+
+#define FEATURES_PER_CHIP	8
+#define LOOKUPS			1000000	/* Per run, roughly */
+
+/* Fill sensors_proc_chips with count fake chips, looking like what we see
+   on large servers: NVMe drives, PMBus power supplies and jc42 DIMM
+   temperature sensors */
+static void add_fake_chips(int count)
+{
+	sensors_chip_features chip;
+	char name[16];
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		memset(&chip, 0, sizeof(chip));
+		switch (i % 3) {
+		case 0:
+			chip.chip.prefix = sensors_intern("nvme");
+			chip.chip.bus.type = SENSORS_BUS_TYPE_PCI;
+			chip.chip.bus.nr = 0;
+			chip.chip.addr = 0x100 + i;
+			break;
+		case 1:
+			chip.chip.prefix = sensors_intern("pmbus");
+			chip.chip.bus.type = SENSORS_BUS_TYPE_I2C;
+			chip.chip.bus.nr = i / 64;
+			chip.chip.addr = 0x40 + i % 64;
+			break;
+		default:
+			chip.chip.prefix = sensors_intern("jc42");
+			chip.chip.bus.type = SENSORS_BUS_TYPE_I2C;
+			chip.chip.bus.nr = 100 + i / 8;
+			chip.chip.addr = 0x18 + i % 8;
+			break;
+		}
+
+		chip.loaded = 1;	/* Nothing to discover */
+		chip.feature_count = chip.subfeature_count = FEATURES_PER_CHIP;
+		chip.feature = sensors_arena_alloc(FEATURES_PER_CHIP *
+						   sizeof(sensors_feature));
+		chip.subfeature = sensors_arena_alloc(FEATURES_PER_CHIP *
+						      sizeof(sensors_subfeature));
+		chip.attr_fd = sensors_arena_alloc(FEATURES_PER_CHIP *
+						   sizeof(int));
+		for (j = 0; j < FEATURES_PER_CHIP; j++) {
+			snprintf(name, sizeof(name), "temp%d", j + 1);
+			chip.feature[j].name = sensors_intern(name);
+			chip.feature[j].number = j;
+			chip.feature[j].type = SENSORS_FEATURE_TEMP;
+			chip.feature[j].first_subfeature = j;
+
+			snprintf(name, sizeof(name), "temp%d_input", j + 1);
+			chip.subfeature[j].name = sensors_intern(name);
+			chip.subfeature[j].number = j;
+			chip.subfeature[j].type = SENSORS_SUBFEATURE_TEMP_INPUT;
+			chip.subfeature[j].mapping = j;
+			chip.subfeature[j].flags = SENSORS_MODE_R;
+			chip.attr_fd[j] = -1;
+		}
+		sensors_add_proc_chips(&chip);
+	}
+}
+
+/* Walk all the features and subfeatures of all chips, the way "sensors"
+   does when it prints all values. Returns the number of subfeatures
+   found, and the elapsed time in ns per chip lookup. */
+static int walk_all(int rounds, double *ns)
+{
+	const sensors_chip_name *name;
+	const sensors_feature *feature;
+	const sensors_subfeature *sub;
+	struct timespec start, end;
+	int r, nr, f, found = 0, lookups = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		nr = 0;
+		while ((name = sensors_get_detected_chips(NULL, &nr))) {
+			f = 0;
+			while ((feature = sensors_get_features(name, &f))) {
+				sub = sensors_get_subfeature(name, feature,
+						SENSORS_SUBFEATURE_TEMP_INPUT);
+				if (sub)
+					found++;
+				lookups += 2;
+			}
+			lookups++;	/* The one which ended the loop */
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	*ns = ((end.tv_sec - start.tv_sec) * 1e9 +
+	       (end.tv_nsec - start.tv_nsec)) / lookups;
+	return found;
+}
+
+static int bench(int count)
+{
+	int rounds, found_linear, found_hash;
+	double ns_linear, ns_hash;
+
+	add_fake_chips(count);
+	rounds = LOOKUPS / (count * (2 * FEATURES_PER_CHIP + 1));
+	if (rounds < 1)
+		rounds = 1;
+
+	sensors_free_proc_chips_index();
+	found_linear = walk_all(rounds, &ns_linear);
+	sensors_index_proc_chips();
+	found_hash = walk_all(rounds, &ns_hash);
+
+	sensors_cleanup();
+
+	if (found_linear != found_hash ||
+	    found_hash != rounds * count * FEATURES_PER_CHIP) {
+		fprintf(stderr, "%d chips: lookup mismatch (%d vs. %d)\n",
+			count, found_linear, found_hash);
+		return 1;
+	}
+
+	printf("%5d chips: linear %9.1f ns/lookup, hashed %6.1f ns/lookup "
+	       "(x%.1f)\n", count, ns_linear, ns_hash, ns_linear / ns_hash);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int counts[] = { 10, 100, 1000 };
+	int i, err = 0;
+
+	if (argc > 1)
+		return bench(atoi(argv[1]));
+
+	for (i = 0; i < (int)(sizeof(counts) / sizeof(counts[0])); i++)
+		err |= bench(counts[i]);
+
+	return err;
+}
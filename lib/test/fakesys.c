@@ -0,0 +1,201 @@
+/*
+    fakesys.c - hwmon devices in a directory standing for sysfs, for the
+                tests which need chips but no hardware.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * Devices are created under devices/virtual/hwmon, with a link in
+ * class/hwmon, as the kernel does. The uevents the kernel would send for
+ * them are built here and applied directly, no socket is involved.
+ */
+
+/* this define needed for mkdtemp() */
+#define _GNU_SOURCE
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../sensors.h"
+#include "../data.h"
+#include "../sysfs.h"
+#include "../hotplug.h"
+#include "fakesys.h"
+
+static char root[PATH_MAX];
+
+/* In the order they are removed */
+static const char *const dirs[] = {
+	"class/hwmon", "class", "devices/virtual/hwmon", "devices/virtual",
+	"devices",
+};
+
+#define DIRS	((int)(sizeof(dirs) / sizeof(dirs[0])))
+
+static void fakesys_path(char *path, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+/* Paths which don't fit are fatal, rather than silently truncated */
+static void fakesys_path(char *path, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(path, PATH_MAX, fmt, ap);
+	va_end(ap);
+	if (len >= PATH_MAX) {
+		fprintf(stderr, "%s: path too long\n", root);
+		exit(1);
+	}
+}
+
+void fakesys_setup(const char *test)
+{
+	char path[PATH_MAX];
+	const char *tmpdir;
+	int i;
+
+	tmpdir = getenv("TMPDIR");
+	fakesys_path(root, "%s/%s.XXXXXX", tmpdir ? tmpdir : "/tmp", test);
+	if (!mkdtemp(root)) {
+		perror(root);
+		exit(1);
+	}
+	for (i = DIRS - 1; i >= 0; i--) {
+		fakesys_path(path, "%s/%s", root, dirs[i]);
+		if (mkdir(path, 0755)) {
+			perror(path);
+			exit(1);
+		}
+	}
+
+	/* Instead of sensors_init(), which would look at the real sysfs */
+	if (snprintf(sensors_sysfs_mount, NAME_MAX, "%s", root) >= NAME_MAX) {
+		fprintf(stderr, "%s: path too long\n", root);
+		exit(1);
+	}
+}
+
+void fakesys_teardown(void)
+{
+	char path[PATH_MAX];
+	struct dirent *ent;
+	DIR *dir;
+	int i;
+
+	fakesys_path(path, "%s/devices/virtual/hwmon", root);
+	if ((dir = opendir(path))) {
+		while ((ent = readdir(dir)))
+			if (!strncmp(ent->d_name, "hwmon", 5))
+				fakesys_delete_device(atoi(ent->d_name + 5));
+		closedir(dir);
+	}
+
+	for (i = 0; i < DIRS; i++) {
+		fakesys_path(path, "%s/%s", root, dirs[i]);
+		rmdir(path);
+	}
+	rmdir(root);
+}
+
+void fakesys_device_path(char *path, int nr)
+{
+	fakesys_path(path, "%s/devices/virtual/hwmon/hwmon%d", root, nr);
+}
+
+void fakesys_create_device(int nr)
+{
+	char path[PATH_MAX], link[PATH_MAX], name[16];
+
+	fakesys_device_path(path, nr);
+	if (mkdir(path, 0755)) {
+		perror(path);
+		exit(1);
+	}
+	snprintf(name, sizeof(name), "hp%d\n", nr);
+	fakesys_write_attr(nr, "name", name);
+
+	fakesys_path(link, "%s/class/hwmon/hwmon%d", root, nr);
+	if (symlink(path, link)) {
+		perror(link);
+		exit(1);
+	}
+}
+
+void fakesys_delete_device(int nr)
+{
+	char path[PATH_MAX], attr[PATH_MAX];
+	struct dirent *ent;
+	DIR *dir;
+
+	fakesys_device_path(path, nr);
+	if ((dir = opendir(path))) {
+		while ((ent = readdir(dir))) {
+			if (ent->d_name[0] == '.')
+				continue;
+			fakesys_path(attr, "%s/%s", path, ent->d_name);
+			unlink(attr);
+		}
+		closedir(dir);
+	}
+	rmdir(path);
+	fakesys_path(path, "%s/class/hwmon/hwmon%d", root, nr);
+	unlink(path);
+}
+
+void fakesys_write_attr(int nr, const char *attr, const char *contents)
+{
+	char path[PATH_MAX];
+	FILE *f;
+
+	fakesys_path(path, "%s/devices/virtual/hwmon/hwmon%d/%s", root, nr,
+		     attr);
+	f = fopen(path, "w");
+	if (!f || fputs(contents, f) == EOF || fclose(f)) {
+		perror(path);
+		exit(1);
+	}
+}
+
+int fakesys_inject(const char *action, int nr, const char *subsystem)
+{
+	char msg[512];
+	int len;
+
+	len = snprintf(msg, sizeof(msg),
+		       "%s@/devices/virtual/hwmon/hwmon%d%c"
+		       "ACTION=%s%c"
+		       "DEVPATH=/devices/virtual/hwmon/hwmon%d%c"
+		       "SUBSYSTEM=%s%c"
+		       "SEQNUM=%d%c",
+		       action, nr, 0, action, 0, nr, 0, subsystem, 0, nr, 0);
+	return sensors_hotplug_apply(msg, len);
+}
+
+void fakesys_announce(int nr)
+{
+	if (fakesys_inject("add", nr, "hwmon") != 1) {
+		fprintf(stderr, "hwmon%d: not added\n", nr);
+		exit(1);
+	}
+}
@@ -0,0 +1,51 @@
+/*
+    fakesys.h - hwmon devices in a directory standing for sysfs, for the
+                tests which need chips but no hardware.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#ifndef LIB_SENSORS_TEST_FAKESYS_H
+#define LIB_SENSORS_TEST_FAKESYS_H
+
+/* Errors are fatal: these functions print them and exit. */
+
+/* Create the directory, named after the test, in $TMPDIR (or /tmp), and
+   point the library at it instead of /sys */
+void fakesys_setup(const char *test);
+
+/* Remove the directory, with the devices left in it */
+void fakesys_teardown(void);
+
+/* Get the path of hwmon<nr>, of size PATH_MAX */
+void fakesys_device_path(char *path, int nr);
+
+/* Create hwmon<nr>, a virtual device named hp<nr> without attributes */
+void fakesys_create_device(int nr);
+
+/* Remove hwmon<nr> and its attributes */
+void fakesys_delete_device(int nr);
+
+/* Create or overwrite an attribute of hwmon<nr> */
+void fakesys_write_attr(int nr, const char *attr, const char *contents);
+
+/* Apply the uevent the kernel sends for hwmon<nr> to the current context.
+   Returns what sensors_hotplug_apply() does. */
+int fakesys_inject(const char *action, int nr, const char *subsystem);
+
+/* Add hwmon<nr> to the current context, it must not be known yet */
+void fakesys_announce(int nr);
+
+#endif /* def LIB_SENSORS_TEST_FAKESYS_H */
@@ -0,0 +1,185 @@
+/*
+    test-alarm.c - Check alarm notifications, with drivers which don't
+                   notify.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * No hardware is needed: hwmon devices are created in a directory which
+ * stands for sysfs, see fakesys.c. Its files can't be polled for
+ * notifications, the way attributes of drivers which don't call
+ * sysfs_notify() behave, so alarm changes must be found by polling.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../sensors.h"
+#include "../data.h"
+#include "../error.h"
+#include "fakesys.h"
+
+#define DEVICES		4
+#define INTERVAL	10	/* ms */
+#define TIMEOUT		2000	/* ms, for changes to be reported */
+
+/* Create hwmon<nr>, a virtual device named hp<nr> with a temperature and
+   a voltage, both with an alarm, and add it to the published context */
+static void add_device(int nr)
+{
+	fakesys_create_device(nr);
+	fakesys_write_attr(nr, "temp1_input", "40000\n");
+	fakesys_write_attr(nr, "temp1_alarm", "0\n");
+	fakesys_write_attr(nr, "in0_input", "1200\n");
+	fakesys_write_attr(nr, "in0_alarm", "0\n");
+	fakesys_announce(nr);
+}
+
+/* Returns the number of the subfeature of the given type of chip hp<nr> */
+static int find_subfeature(int nr, sensors_subfeature_type type,
+			   const sensors_chip_name **chip)
+{
+	const sensors_chip_name *name;
+	const sensors_feature *feature;
+	const sensors_subfeature *sub;
+	char prefix[16];
+	int cnr = 0, fnr;
+
+	snprintf(prefix, sizeof(prefix), "hp%d", nr);
+	while ((name = sensors_get_detected_chips(NULL, &cnr))) {
+		if (strcmp(name->prefix, prefix))
+			continue;
+		fnr = 0;
+		while ((feature = sensors_get_features(name, &fnr)))
+			if ((sub = sensors_get_subfeature(name, feature,
+							  type))) {
+				*chip = name;
+				return sub->number;
+			}
+	}
+	fprintf(stderr, "%s: subfeature %#x not found\n", prefix, type);
+	exit(1);
+}
+
+/* Returns 1 if fd becomes readable within timeout ms */
+static int wait_fd(int fd, int timeout)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	return poll(&pfd, 1, timeout) == 1;
+}
+
+static int run_tests(void)
+{
+	sensors_alarm_event events[2 * DEVICES];
+	const sensors_chip_name *chip;
+	int i, fd, n, subfeat_nr, err = 0;
+
+	for (i = 0; i < DEVICES; i++)
+		add_device(i);
+
+	fd = sensors_alarm_open(INTERVAL);
+	if (fd < 0) {
+		fprintf(stderr, "sensors_alarm_open: %s\n",
+			sensors_strerror(fd));
+		return 1;
+	}
+
+	/* Nothing changed yet, the current values are not reported */
+	usleep(3 * INTERVAL * 1000);
+	if (sensors_alarm_drain(events, 2 * DEVICES) != 0) {
+		fprintf(stderr, "Unchanged alarms reported\n");
+		err = 1;
+	}
+
+	/* A single change is reported once, with the new value */
+	subfeat_nr = find_subfeature(2, SENSORS_SUBFEATURE_TEMP_ALARM, &chip);
+	fakesys_write_attr(2, "temp1_alarm", "1\n");
+	if (!wait_fd(fd, TIMEOUT) ||
+	    sensors_alarm_drain(events, 2 * DEVICES) != 1 ||
+	    events[0].name != chip || events[0].subfeat_nr != subfeat_nr ||
+	    events[0].value != 1) {
+		fprintf(stderr, "Alarm change not reported\n");
+		err = 1;
+	}
+	if (sensors_alarm_drain(events, 2 * DEVICES) != 0) {
+		fprintf(stderr, "Alarm change reported twice\n");
+		err = 1;
+	}
+
+	/* Changes which don't fit are reported by the next calls */
+	for (i = 0; i < DEVICES; i++)
+		fakesys_write_attr(i, "in0_alarm", "1\n");
+	usleep(3 * INTERVAL * 1000);
+	if (!wait_fd(fd, TIMEOUT)) {
+		fprintf(stderr, "Alarm changes not reported\n");
+		err = 1;
+	}
+	for (i = 0; i < DEVICES; i++) {
+		subfeat_nr = find_subfeature(i, SENSORS_SUBFEATURE_IN_ALARM,
+					     &chip);
+		n = sensors_alarm_drain(events, 1);
+		if (n != 1 || events[0].name != chip ||
+		    events[0].subfeat_nr != subfeat_nr) {
+			fprintf(stderr, "hp%d: alarm change not reported\n",
+				i);
+			err = 1;
+		}
+	}
+	if (sensors_alarm_drain(events, 1) != 0) {
+		fprintf(stderr, "Too many alarm changes\n");
+		err = 1;
+	}
+
+	sensors_alarm_close();
+
+	/* Without polling, changes of these files go unnoticed */
+	fd = sensors_alarm_open(0);
+	if (fd < 0) {
+		fprintf(stderr, "sensors_alarm_open: %s\n",
+			sensors_strerror(fd));
+		return 1;
+	}
+	fakesys_write_attr(0, "temp1_alarm", "1\n");
+	if (wait_fd(fd, 5 * INTERVAL) ||
+	    sensors_alarm_drain(events, 2 * DEVICES) != 0) {
+		fprintf(stderr, "Alarm polled with interval 0\n");
+		err = 1;
+	}
+	sensors_alarm_close();
+
+	return err;
+}
+
+int main(void)
+{
+	int err;
+
+	fakesys_setup("test-alarm");
+
+	err = run_tests();
+	printf("%s\n", err ? "FAILED" : "OK");
+
+	sensors_cleanup();
+	fakesys_teardown();
+
+	return err;
+}
@@ -0,0 +1,346 @@
+/*
+    test-classify.c - Check that the sysfs attribute name classifier gives
+                      exactly the same results as the sscanf()-based one
+                      it replaced.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * Usage: test-classify
+ * Attribute names are built from all combinations of prefixes, channel
+ * numbers, separators and suffixes, both valid and slightly wrong ones,
+ * plus all the truncations of the valid names, plus random names. Each
+ * name is classified by both implementations, and the types and channel
+ * numbers are compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../sensors.h"
+#include "../data.h"
+#include "../sysfs.h"
+#include "../general.h"
+
+/* Reference implementation: what libsensors did before, verbatim */
+
+struct subfeature_type_match
+{
+	const char *name;
+	sensors_subfeature_type type;
+};
+
+struct feature_type_match
+{
+	const char *name;
+	const struct subfeature_type_match *submatches;
+};
+
+static const struct subfeature_type_match temp_matches[] = {
+	{ "input", SENSORS_SUBFEATURE_TEMP_INPUT },
+	{ "max", SENSORS_SUBFEATURE_TEMP_MAX },
+	{ "max_hyst", SENSORS_SUBFEATURE_TEMP_MAX_HYST },
+	{ "min", SENSORS_SUBFEATURE_TEMP_MIN },
+	{ "min_hyst", SENSORS_SUBFEATURE_TEMP_MIN_HYST },
+	{ "crit", SENSORS_SUBFEATURE_TEMP_CRIT },
+	{ "crit_hyst", SENSORS_SUBFEATURE_TEMP_CRIT_HYST },
+	{ "lcrit", SENSORS_SUBFEATURE_TEMP_LCRIT },
+	{ "lcrit_hyst", SENSORS_SUBFEATURE_TEMP_LCRIT_HYST },
+	{ "emergency", SENSORS_SUBFEATURE_TEMP_EMERGENCY },
+	{ "emergency_hyst", SENSORS_SUBFEATURE_TEMP_EMERGENCY_HYST },
+	{ "lowest", SENSORS_SUBFEATURE_TEMP_LOWEST },
+	{ "highest", SENSORS_SUBFEATURE_TEMP_HIGHEST },
+	{ "alarm", SENSORS_SUBFEATURE_TEMP_ALARM },
+	{ "min_alarm", SENSORS_SUBFEATURE_TEMP_MIN_ALARM },
+	{ "max_alarm", SENSORS_SUBFEATURE_TEMP_MAX_ALARM },
+	{ "crit_alarm", SENSORS_SUBFEATURE_TEMP_CRIT_ALARM },
+	{ "emergency_alarm", SENSORS_SUBFEATURE_TEMP_EMERGENCY_ALARM },
+	{ "lcrit_alarm", SENSORS_SUBFEATURE_TEMP_LCRIT_ALARM },
+	{ "fault", SENSORS_SUBFEATURE_TEMP_FAULT },
+	{ "type", SENSORS_SUBFEATURE_TEMP_TYPE },
+	{ "offset", SENSORS_SUBFEATURE_TEMP_OFFSET },
+	{ "beep", SENSORS_SUBFEATURE_TEMP_BEEP },
+	{ NULL, 0 }
+};
+
+static const struct subfeature_type_match in_matches[] = {
+	{ "input", SENSORS_SUBFEATURE_IN_INPUT },
+	{ "min", SENSORS_SUBFEATURE_IN_MIN },
+	{ "max", SENSORS_SUBFEATURE_IN_MAX },
+	{ "lcrit", SENSORS_SUBFEATURE_IN_LCRIT },
+	{ "crit", SENSORS_SUBFEATURE_IN_CRIT },
+	{ "average", SENSORS_SUBFEATURE_IN_AVERAGE },
+	{ "lowest", SENSORS_SUBFEATURE_IN_LOWEST },
+	{ "highest", SENSORS_SUBFEATURE_IN_HIGHEST },
+	{ "alarm", SENSORS_SUBFEATURE_IN_ALARM },
+	{ "min_alarm", SENSORS_SUBFEATURE_IN_MIN_ALARM },
+	{ "max_alarm", SENSORS_SUBFEATURE_IN_MAX_ALARM },
+	{ "lcrit_alarm", SENSORS_SUBFEATURE_IN_LCRIT_ALARM },
+	{ "crit_alarm", SENSORS_SUBFEATURE_IN_CRIT_ALARM },
+	{ "beep", SENSORS_SUBFEATURE_IN_BEEP },
+	{ NULL, 0 }
+};
+
+static const struct subfeature_type_match fan_matches[] = {
+	{ "input", SENSORS_SUBFEATURE_FAN_INPUT },
+	{ "min", SENSORS_SUBFEATURE_FAN_MIN },
+	{ "max", SENSORS_SUBFEATURE_FAN_MAX },
+	{ "div", SENSORS_SUBFEATURE_FAN_DIV },
+	{ "pulses", SENSORS_SUBFEATURE_FAN_PULSES },
+	{ "alarm", SENSORS_SUBFEATURE_FAN_ALARM },
+	{ "min_alarm", SENSORS_SUBFEATURE_FAN_MIN_ALARM },
+	{ "max_alarm", SENSORS_SUBFEATURE_FAN_MAX_ALARM },
+	{ "fault", SENSORS_SUBFEATURE_FAN_FAULT },
+	{ "beep", SENSORS_SUBFEATURE_FAN_BEEP },
+	{ NULL, 0 }
+};
+
+static const struct subfeature_type_match power_matches[] = {
+	{ "average", SENSORS_SUBFEATURE_POWER_AVERAGE },
+	{ "average_highest", SENSORS_SUBFEATURE_POWER_AVERAGE_HIGHEST },
+	{ "average_lowest", SENSORS_SUBFEATURE_POWER_AVERAGE_LOWEST },
+	{ "input", SENSORS_SUBFEATURE_POWER_INPUT },
+	{ "input_highest", SENSORS_SUBFEATURE_POWER_INPUT_HIGHEST },
+	{ "input_lowest", SENSORS_SUBFEATURE_POWER_INPUT_LOWEST },
+	{ "cap", SENSORS_SUBFEATURE_POWER_CAP },
+	{ "cap_hyst", SENSORS_SUBFEATURE_POWER_CAP_HYST },
+	{ "cap_alarm", SENSORS_SUBFEATURE_POWER_CAP_ALARM },
+	{ "alarm", SENSORS_SUBFEATURE_POWER_ALARM },
+	{ "max", SENSORS_SUBFEATURE_POWER_MAX },
+	{ "min", SENSORS_SUBFEATURE_POWER_MIN },
+	{ "min_alarm", SENSORS_SUBFEATURE_POWER_MIN_ALARM },
+	{ "max_alarm", SENSORS_SUBFEATURE_POWER_MAX_ALARM },
+	{ "crit", SENSORS_SUBFEATURE_POWER_CRIT },
+	{ "lcrit", SENSORS_SUBFEATURE_POWER_LCRIT },
+	{ "crit_alarm", SENSORS_SUBFEATURE_POWER_CRIT_ALARM },
+	{ "lcrit_alarm", SENSORS_SUBFEATURE_POWER_LCRIT_ALARM },
+	{ "average_interval", SENSORS_SUBFEATURE_POWER_AVERAGE_INTERVAL },
+	{ NULL, 0 }
+};
+
+static const struct subfeature_type_match energy_matches[] = {
+	{ "input", SENSORS_SUBFEATURE_ENERGY_INPUT },
+	{ NULL, 0 }
+};
+
+static const struct subfeature_type_match curr_matches[] = {
+	{ "input", SENSORS_SUBFEATURE_CURR_INPUT },
+	{ "min", SENSORS_SUBFEATURE_CURR_MIN },
+	{ "max", SENSORS_SUBFEATURE_CURR_MAX },
+	{ "lcrit", SENSORS_SUBFEATURE_CURR_LCRIT },
+	{ "crit", SENSORS_SUBFEATURE_CURR_CRIT },
+	{ "average", SENSORS_SUBFEATURE_CURR_AVERAGE },
+	{ "lowest", SENSORS_SUBFEATURE_CURR_LOWEST },
+	{ "highest", SENSORS_SUBFEATURE_CURR_HIGHEST },
+	{ "alarm", SENSORS_SUBFEATURE_CURR_ALARM },
+	{ "min_alarm", SENSORS_SUBFEATURE_CURR_MIN_ALARM },
+	{ "max_alarm", SENSORS_SUBFEATURE_CURR_MAX_ALARM },
+	{ "lcrit_alarm", SENSORS_SUBFEATURE_CURR_LCRIT_ALARM },
+	{ "crit_alarm", SENSORS_SUBFEATURE_CURR_CRIT_ALARM },
+	{ "beep", SENSORS_SUBFEATURE_CURR_BEEP },
+	{ NULL, 0 }
+};
+
+static const struct subfeature_type_match humidity_matches[] = {
+	{ "input", SENSORS_SUBFEATURE_HUMIDITY_INPUT },
+	{ NULL, 0 }
+};
+
+static const struct subfeature_type_match cpu_matches[] = {
+	{ "vid", SENSORS_SUBFEATURE_VID },
+	{ NULL, 0 }
+};
+
+static const struct subfeature_type_match intrusion_matches[] = {
+	{ "alarm", SENSORS_SUBFEATURE_INTRUSION_ALARM },
+	{ "beep", SENSORS_SUBFEATURE_INTRUSION_BEEP },
+	{ NULL, 0 }
+};
+static struct feature_type_match matches[] = {
+	{ "temp%d%c", temp_matches },
+	{ "in%d%c", in_matches },
+	{ "fan%d%c", fan_matches },
+	{ "cpu%d%c", cpu_matches },
+	{ "power%d%c", power_matches },
+	{ "curr%d%c", curr_matches },
+	{ "energy%d%c", energy_matches },
+	{ "intrusion%d%c", intrusion_matches },
+	{ "humidity%d%c", humidity_matches },
+};
+
+static
+sensors_subfeature_type old_get_type(const char *name, int *nr)
+{
+	char c;
+	int i, count;
+	const struct subfeature_type_match *submatches;
+
+	/* Special case */
+	if (!strcmp(name, "beep_enable")) {
+		*nr = 0;
+		return SENSORS_SUBFEATURE_BEEP_ENABLE;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(matches); i++)
+		if ((count = sscanf(name, matches[i].name, nr, &c)))
+			break;
+
+	if (i == ARRAY_SIZE(matches) || count != 2 || c != '_')
+		return SENSORS_SUBFEATURE_UNKNOWN;  /* no match */
+
+	submatches = matches[i].submatches;
+	name = strchr(name + 3, '_') + 1;
+	for (i = 0; submatches[i].name != NULL; i++)
+		if (!strcmp(name, submatches[i].name))
+			return submatches[i].type;
+
+	return SENSORS_SUBFEATURE_UNKNOWN;
+}
+
+/* End of the reference implementation */
+
+static const char *prefixes[] = {
+	"temp", "in", "fan", "cpu", "power", "curr", "energy", "intrusion",
+	"humidity", "", "t", "te", "tem", "i", "int", "intr", "cp", "cu",
+	"pwm", "Temp", "tempp", "inn", "beep", "beep_enable", "vid", "name",
+	"update_interval", "fan_", "in_", "temp_",
+};
+
+static const char *numbers[] = {
+	"", "0", "1", "2", "9", "10", "01", "007", "63", "1023", "1024",
+	"65535", "2147483647", "2147483648", "-1", "-0", "+1", "+", "-",
+	" 1", "\t2", "\n3", " ", "1 ", "4294967296", "4294967297",
+	"9223372036854775807", "9223372036854775808",
+	"-9223372036854775808", "-9223372036854775809",
+	"99999999999999999999999", "-99999999999999999999999", "x", "1x",
+};
+
+static const char *separators[] = {
+	"", "_", "__", "-", "x", " ", "_enable",
+};
+
+static const char *extra_suffixes[] = {
+	"", "_", "inp", "inputs", "Input", "max_", "_max", "min_hyst_alarm",
+	"alarms", "beep_enable", "label", "enable", "crit_hys", "type ",
+	"average_interval_max", "vidx", "lowest_", "interval",
+};
+
+static int tested, bad;
+
+static void check(const char *name)
+{
+	sensors_subfeature_type ref, res;
+	int ref_nr = -12345, res_nr = -12345;
+
+	ref = old_get_type(name, &ref_nr);
+	res = sensors_subfeature_get_type(name, &res_nr);
+	tested++;
+
+	/* The channel number only matters if the name was recognized */
+	if (ref == res && (ref == SENSORS_SUBFEATURE_UNKNOWN ||
+			   ref_nr == res_nr))
+		return;
+
+	fprintf(stderr, "\"%s\": expected %#x (%d), got %#x (%d)\n", name,
+		ref, ref_nr, res, res_nr);
+	bad++;
+}
+
+/* Check a name and all its truncations */
+static void check_truncations(const char *name)
+{
+	char buf[128];
+	int len;
+
+	for (len = strlen(name); len >= 0; len--) {
+		memcpy(buf, name, len);
+		buf[len] = '\0';
+		check(buf);
+	}
+}
+
+static void check_suffixes(const char *base)
+{
+	const struct subfeature_type_match *submatches;
+	char name[128];
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(matches); i++) {
+		submatches = matches[i].submatches;
+		for (j = 0; submatches[j].name != NULL; j++) {
+			snprintf(name, sizeof(name), "%s%s", base,
+				 submatches[j].name);
+			check(name);
+		}
+	}
+	for (i = 0; i < ARRAY_SIZE(extra_suffixes); i++) {
+		snprintf(name, sizeof(name), "%s%s", base, extra_suffixes[i]);
+		check(name);
+	}
+}
+
+/* Random names from a small alphabet, so that they often look like
+   attribute names */
+static void check_random(int count)
+{
+	static const char alphabet[] = "tempincufaowrgyhdsl_0123456789-+ ";
+	char name[24];
+	int i, j, len;
+
+	srand(1);
+	for (i = 0; i < count; i++) {
+		len = rand() % (sizeof(name) - 1);
+		for (j = 0; j < len; j++)
+			name[j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+		name[len] = '\0';
+		check(name);
+	}
+}
+
+int main(void)
+{
+	const struct subfeature_type_match *submatches;
+	char base[64], name[128];
+	int p, n, s, i, j;
+
+	for (p = 0; p < ARRAY_SIZE(prefixes); p++)
+		for (n = 0; n < ARRAY_SIZE(numbers); n++)
+			for (s = 0; s < ARRAY_SIZE(separators); s++) {
+				snprintf(base, sizeof(base), "%s%s%s",
+					 prefixes[p], numbers[n],
+					 separators[s]);
+				check_suffixes(base);
+			}
+
+	/* All truncations of all valid names */
+	for (i = 0; i < ARRAY_SIZE(matches); i++) {
+		submatches = matches[i].submatches;
+		for (j = 0; submatches[j].name != NULL; j++) {
+			snprintf(name, sizeof(name), "%.*s12_%s",
+				 (int)(strchr(matches[i].name, '%') -
+				       matches[i].name),
+				 matches[i].name, submatches[j].name);
+			check_truncations(name);
+		}
+	}
+	check_truncations("beep_enable");
+
+	check_random(1000000);
+
+	printf("%d names tested, %d mismatches\n", tested, bad);
+	return bad ? 1 : 0;
+}
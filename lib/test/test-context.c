@@ -0,0 +1,289 @@
+/*
+    test-context.c - Check that contexts are independent, can be read
+                     from several threads at once, and can be replaced
+                     while being read.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * No hardware is needed: hwmon devices are created in a directory which
+ * stands for sysfs, see fakesys.c, and added to each context through the
+ * uevents the kernel would send. The features of the chips are only
+ * discovered when the threads first read them, so that happens
+ * concurrently too.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../sensors.h"
+#include "../data.h"
+#include "../error.h"
+#include "../sysfs.h"
+#include "fakesys.h"
+
+#define CONTEXTS	2
+#define DEVICES		50	/* Per context */
+#define THREADS		8
+#define ROUNDS		200
+#define GENERATIONS	100	/* Contexts published while reading */
+
+struct thread_data {
+	sensors_context *ctx;
+	int first;		/* Number of the first device of ctx */
+	int err;
+	int rounds;
+};
+
+static int stop_readers;
+
+/* Create hwmon<nr>, a virtual device named hp<nr> with temp1_input and
+   in0_input, and tell the current context about it */
+static void add_device(int nr)
+{
+	char value[16];
+
+	fakesys_create_device(nr);
+	snprintf(value, sizeof(value), "%d\n", nr * 1000);
+	fakesys_write_attr(nr, "temp1_input", value);
+	fakesys_write_attr(nr, "in0_input", value);
+
+	fakesys_announce(nr);
+}
+
+/* Read all the values of the chips of ctx, and check that they are those
+   of the devices numbered from first, or of any context if first is -1.
+   Returns 1 on error. */
+static int check_context(sensors_context *ctx, int first)
+{
+	const sensors_chip_name *name;
+	const sensors_feature *feature;
+	const sensors_subfeature *sub;
+	sensors_subfeature_type type;
+	double value;
+	int nr = 0, fnr, chip_nr, count = 0, err = 0;
+
+	while ((name = sensors_get_detected_chips_ctx(ctx, NULL, &nr))) {
+		chip_nr = atoi(name->prefix + 2);
+		if (first < 0)
+			first = chip_nr - chip_nr % DEVICES;
+		if (chip_nr < first || chip_nr >= first + DEVICES) {
+			fprintf(stderr, "%s: wrong context\n", name->prefix);
+			err = 1;
+		}
+
+		fnr = 0;
+		while ((feature = sensors_get_features_ctx(ctx, name, &fnr))) {
+			type = feature->type == SENSORS_FEATURE_IN ?
+			       SENSORS_SUBFEATURE_IN_INPUT :
+			       SENSORS_SUBFEATURE_TEMP_INPUT;
+			sub = sensors_get_subfeature_ctx(ctx, name, feature,
+							 type);
+			if (!sub ||
+			    sensors_get_value_ctx(ctx, name, sub->number,
+						  &value) ||
+			    value != chip_nr) {
+				fprintf(stderr, "%s: wrong value\n",
+					name->prefix);
+				err = 1;
+			}
+		}
+		count++;
+	}
+	if (count != DEVICES) {
+		fprintf(stderr, "%d chips instead of %d\n", count, DEVICES);
+		err = 1;
+	}
+	return err;
+}
+
+/* Each thread reads all the values of the chips of its context, and
+   checks that it never sees the chips of the other context */
+static void *read_context(void *arg)
+{
+	struct thread_data *data = arg;
+
+	for (data->rounds = 0; data->rounds < ROUNDS && !data->err;
+	     data->rounds++)
+		data->err = check_context(data->ctx, data->first);
+	return NULL;
+}
+
+/* Same with the published context, until told to stop. Each context it
+   gets must be complete and consistent, whichever was published last.
+   Threads with first set only take and drop references as fast as they
+   can, so that there is always one being taken while publishing. */
+static void *read_published(void *arg)
+{
+	struct thread_data *data = arg;
+	sensors_context *ctx;
+
+	for (data->rounds = 0;
+	     !__atomic_load_n(&stop_readers, __ATOMIC_ACQUIRE) && !data->err;
+	     data->rounds++) {
+		ctx = sensors_context_acquire();
+		if (!data->first)
+			data->err = check_context(ctx, -1);
+		sensors_context_release(ctx);
+	}
+	return NULL;
+}
+
+/* Build a context with the devices of context c, off to the side */
+static sensors_context *new_generation(int c)
+{
+	sensors_context *ctx;
+	int i;
+
+	ctx = sensors_context_new();
+	sensors_current_context = ctx;
+	for (i = 0; i < DEVICES; i++)
+		fakesys_announce(c * DEVICES + i);
+	sensors_current_context = NULL;
+
+	return ctx;
+}
+
+/* Publish new contexts while threads read the published one */
+static int run_publish_tests(void)
+{
+	sensors_context *def;
+	struct thread_data data[THREADS];
+	pthread_t tids[THREADS];
+	int i, g, err = 0;
+
+	/* To publish it again at the end */
+	def = sensors_context_acquire();
+
+	sensors_context_publish(new_generation(0));
+	for (i = 0; i < THREADS; i++) {
+		data[i].err = 0;
+		data[i].first = i % 2;
+		if (pthread_create(&tids[i], NULL, read_published, &data[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	for (g = 1; g <= GENERATIONS; g++)
+		sensors_context_publish(new_generation(g % CONTEXTS));
+
+	__atomic_store_n(&stop_readers, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < THREADS; i++) {
+		pthread_join(tids[i], NULL);
+		if (!data[i].rounds) {
+			fprintf(stderr, "Thread %d did not read\n", i);
+			err = 1;
+		}
+		err |= data[i].err;
+	}
+
+	sensors_context_publish(def);
+	return err;
+}
+
+/* Enumerating the chips of the published context with threads, as
+   sensors_init() does, must not tie the calling thread to that context:
+   it must follow the contexts published next */
+static int run_init_threads_tests(void)
+{
+	sensors_context *def, *ctx;
+	int nr = 0, count = 0, err = 0;
+
+	/* Built first, it sets the context of the thread */
+	ctx = new_generation(1);
+
+	sensors_set_option(SENSORS_OPT_INIT_THREADS, 4);
+	err = sensors_read_sysfs_chips(NULL, 0) != 0;
+	sensors_set_option(SENSORS_OPT_INIT_THREADS, 0);
+	if (err) {
+		fprintf(stderr, "Chips not enumerated with threads\n");
+		sensors_context_free(ctx);
+		return 1;
+	}
+
+	def = sensors_context_acquire();
+	sensors_context_publish(ctx);
+	while (sensors_get_detected_chips(NULL, &nr))
+		count++;
+	if (count != DEVICES) {
+		fprintf(stderr, "Thread still on the previous context\n");
+		err = 1;
+	}
+
+	sensors_context_publish(def);
+	sensors_cleanup();
+	return err;
+}
+
+static int run_tests(void)
+{
+	sensors_context *ctx[CONTEXTS];
+	struct thread_data data[THREADS];
+	pthread_t tids[THREADS];
+	int i, c, nr, err = 0;
+
+	for (c = 0; c < CONTEXTS; c++) {
+		ctx[c] = sensors_context_new();
+		sensors_current_context = ctx[c];
+		for (i = 0; i < DEVICES; i++)
+			add_device(c * DEVICES + i);
+	}
+	sensors_current_context = NULL;
+
+	/* The default context was left alone */
+	nr = 0;
+	if (sensors_get_detected_chips(NULL, &nr)) {
+		fprintf(stderr, "Default context not empty\n");
+		err = 1;
+	}
+
+	for (i = 0; i < THREADS; i++) {
+		c = i % CONTEXTS;
+		data[i].ctx = ctx[c];
+		data[i].first = c * DEVICES;
+		data[i].err = 0;
+		if (pthread_create(&tids[i], NULL, read_context, &data[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < THREADS; i++) {
+		pthread_join(tids[i], NULL);
+		err |= data[i].err;
+	}
+
+	for (c = 0; c < CONTEXTS; c++)
+		sensors_context_free(ctx[c]);
+
+	err |= run_publish_tests();
+	return err | run_init_threads_tests();
+}
+
+int main(void)
+{
+	int err;
+
+	fakesys_setup("test-context");
+
+	err = run_tests();
+	printf("%s\n", err ? "FAILED" : "OK");
+
+	fakesys_teardown();
+
+	return err;
+}
@@ -0,0 +1,225 @@
+/*
+    test-fold.c - Check that compiled (and folded) configuration file
+                  expressions give exactly the same results as the
+                  original expression trees.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * Usage: test-fold FILE...
+ * where each FILE is a configuration file, e.g.:
+ *   find configs -type f | xargs lib/test/test-fold lib/test/fold.conf
+ * All compute and set expressions of all the files are evaluated on a
+ * range of values, both by walking the expression tree and by running
+ * the compiled program, and the results are compared bit for bit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "../data.h"
+#include "../error.h"
+#include "../conf.h"
+#include "../scanner.h"
+#include "../expr.h"
+#include "../general.h"
+
+/* Raw values and variable values to try. Signaling NaNs are left out,
+   strtod() never returns them. */
+static const double test_values[] = {
+	0.0, -0.0, 1.0, -1.0, 0.5, -0.5, 2.0, 3.3, -12.0, 1000.0,
+	1.0 / 3.0, 0.1, 12345.678, -98765.4321, 1e-300, -1e-300,
+	DBL_MIN, DBL_MIN / 4, -DBL_MIN / 4, DBL_MAX, -DBL_MAX, 1e300,
+	HUGE_VAL, -HUGE_VAL, NAN, -NAN,
+};
+
+#define NR_VALUES	ARRAY_SIZE(test_values)
+
+static int round_nr;
+
+/* Give each variable a different value in each round */
+static double var_value(const char *name)
+{
+	unsigned int hash = 0;
+
+	while (*name)
+		hash = hash * 31 + (unsigned char)*name++;
+	return test_values[(hash + round_nr) % NR_VALUES];
+}
+
+static int get_var(const void *data, int var, double *value)
+{
+	const sensors_prog *prog = data;
+
+	*value = var_value(prog->vars[var]);
+	return 0;
+}
+
+/* Reference implementation: what libsensors did before expressions were
+   compiled */
+static int eval_tree(const sensors_expr *expr, double val, double *result)
+{
+	double res1, res2;
+	int res;
+
+	if (expr->kind == sensors_kind_val) {
+		*result = expr->data.val;
+		return 0;
+	}
+	if (expr->kind == sensors_kind_source) {
+		*result = val;
+		return 0;
+	}
+	if (expr->kind == sensors_kind_var) {
+		*result = var_value(expr->data.var);
+		return 0;
+	}
+	if ((res = eval_tree(expr->data.subexpr.sub1, val, &res1)))
+		return res;
+	if (expr->data.subexpr.sub2 &&
+	    (res = eval_tree(expr->data.subexpr.sub2, val, &res2)))
+		return res;
+	switch (expr->data.subexpr.op) {
+	case sensors_add:
+		*result = res1 + res2;
+		return 0;
+	case sensors_sub:
+		*result = res1 - res2;
+		return 0;
+	case sensors_multiply:
+		*result = res1 * res2;
+		return 0;
+	case sensors_divide:
+		if (res2 == 0.0)
+			return -SENSORS_ERR_DIV_ZERO;
+		*result = res1 / res2;
+		return 0;
+	case sensors_negate:
+		*result = -res1;
+		return 0;
+	case sensors_exp:
+		*result = exp(res1);
+		return 0;
+	case sensors_log:
+		if (res1 < 0.0)
+			return -SENSORS_ERR_DIV_ZERO;
+		*result = log(res1);
+		return 0;
+	}
+	return 0;
+}
+
+static int tree_nodes;
+static int prog_insns;
+
+/* Returns the number of mismatches */
+static int check_expr(const sensors_expr *expr, const sensors_prog *prog,
+		      const sensors_config_line *line)
+{
+	double ref, res;
+	int i, err_ref, err_res, bad = 0;
+
+	for (round_nr = 0; round_nr < (int)NR_VALUES; round_nr++) {
+		for (i = 0; i < (int)NR_VALUES; i++) {
+			ref = res = 0.0;
+			err_ref = eval_tree(expr, test_values[i], &ref);
+			err_res = sensors_run_prog(prog, test_values[i],
+						   get_var, prog, &res);
+			if (err_ref == err_res &&
+			    (err_ref || !memcmp(&ref, &res, sizeof(double))))
+				continue;
+
+			fprintf(stderr, "%s:%d: @ = %g: expected %a (%d), "
+				"got %a (%d)\n", line->filename, line->lineno,
+				test_values[i], ref, err_ref, res, err_res);
+			bad++;
+		}
+	}
+
+	return bad;
+}
+
+static int count_nodes(const sensors_expr *expr)
+{
+	if (expr->kind != sensors_kind_sub)
+		return 1;
+	return 1 + count_nodes(expr->data.subexpr.sub1) +
+	       (expr->data.subexpr.sub2 ?
+		count_nodes(expr->data.subexpr.sub2) : 0);
+}
+
+static int check_config(void)
+{
+	const sensors_chip *chip;
+	const sensors_compute *compute;
+	const sensors_set *set;
+	int i, j, bad = 0;
+
+	for (i = 0; i < sensors_config_chips_count; i++) {
+		chip = &sensors_config_chips[i];
+		for (j = 0; j < chip->computes_count; j++) {
+			compute = &chip->computes[j];
+			bad += check_expr(compute->from_proc,
+					  compute->from_prog, &compute->line);
+			bad += check_expr(compute->to_proc,
+					  compute->to_prog, &compute->line);
+			tree_nodes += count_nodes(compute->from_proc) +
+				      count_nodes(compute->to_proc);
+			prog_insns += compute->from_prog->code_count +
+				      compute->to_prog->code_count;
+		}
+		for (j = 0; j < chip->sets_count; j++) {
+			set = &chip->sets[j];
+			bad += check_expr(set->value, set->prog, &set->line);
+			tree_nodes += count_nodes(set->value);
+			prog_insns += set->prog->code_count;
+		}
+	}
+
+	return bad;
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *input;
+	int i, bad = 0;
+
+	for (i = 1; i < argc; i++) {
+		input = fopen(argv[i], "r");
+		if (!input) {
+			perror(argv[i]);
+			return 1;
+		}
+
+		if (sensors_scanner_init(input, argv[i]) ||
+		    sensors_yyparse()) {
+			fprintf(stderr, "%s: Parse error\n", argv[i]);
+			bad++;
+		}
+		sensors_scanner_exit();
+		fclose(input);
+	}
+
+	bad += check_config();
+	printf("%d expression nodes compiled to %d instructions, "
+	       "%d mismatches\n", tree_nodes, prog_insns, bad);
+
+	sensors_cleanup();
+	return bad ? 1 : 0;
+}
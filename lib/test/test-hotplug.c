@@ -0,0 +1,292 @@
+/*
+    test-hotplug.c - Check that hotplug events add and remove chips, and
+                     that chip names returned before stay valid.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * No hardware is needed: hwmon devices are created in a directory which
+ * stands for sysfs, see fakesys.c, and the uevents the kernel would send
+ * for them are injected directly. Lost events are simulated by replacing
+ * recvmsg(), which only the library's hotplug socket uses.
+ */
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../sensors.h"
+#include "../data.h"
+#include "../error.h"
+#include "../hotplug.h"
+#include "fakesys.h"
+
+#define DEVICES		200	/* Enough for sensors_proc_chips to grow */
+
+static int lose_events;
+
+/* The uevent socket never has anything to read, but reports that events
+   were lost if lose_events is set */
+ssize_t recvmsg(int fd, struct msghdr *msg, int flags)
+{
+	(void)fd;
+	(void)msg;
+	(void)flags;
+	if (lose_events) {
+		lose_events = 0;
+		errno = ENOBUFS;
+	} else {
+		errno = EAGAIN;
+	}
+	return -1;
+}
+
+/* Create hwmon<nr>, a virtual device named hp<nr> with temp1_input */
+static void create_device(int nr)
+{
+	char value[16];
+
+	fakesys_create_device(nr);
+	snprintf(value, sizeof(value), "%d\n", nr * 1000);
+	fakesys_write_attr(nr, "temp1_input", value);
+}
+
+static int count_chips(void)
+{
+	int nr = 0, count = 0;
+
+	while (sensors_get_detected_chips(NULL, &nr))
+		count++;
+	return count;
+}
+
+/* Returns 0 if the chip reads as expected */
+static int check_chip(const sensors_chip_name *name, int nr)
+{
+	char expected[16];
+	double value;
+
+	snprintf(expected, sizeof(expected), "hp%d", nr);
+	if (strcmp(name->prefix, expected) ||
+	    sensors_get_value(name, 0, &value) || value != nr) {
+		fprintf(stderr, "hwmon%d: wrong chip or value\n", nr);
+		return 1;
+	}
+	return 0;
+}
+
+/* hwmon0 comes back with other attributes, as a PSU of another model
+   behind the same driver and address would: the chip must not keep the
+   features of the previous device. Returns 0 if it doesn't. */
+static int check_replaced(const sensors_chip_name *name)
+{
+	const sensors_feature *old, *feature;
+	const sensors_subfeature *sf;
+	const char *label;
+	double value;
+	int nr = 0, count = 0, err = 0;
+
+	old = sensors_get_features(name, &nr);
+	fakesys_delete_device(0);
+	err |= fakesys_inject("remove", 0, "hwmon") != 1;
+	fakesys_create_device(0);
+	fakesys_write_attr(0, "in0_input", "1500\n");
+	fakesys_write_attr(0, "in1_input", "3300\n");
+	err |= fakesys_inject("add", 0, "hwmon") != 1;
+	if (err) {
+		fprintf(stderr, "hwmon0: not replaced\n");
+		return 1;
+	}
+
+	nr = 0;
+	while ((feature = sensors_get_features(name, &nr))) {
+		count++;
+		if (feature->type != SENSORS_FEATURE_IN) {
+			fprintf(stderr, "hwmon0: %s of the previous device\n",
+				feature->name);
+			return 1;
+		}
+		sf = sensors_get_subfeature(name, feature,
+					    SENSORS_SUBFEATURE_IN_INPUT);
+		label = sensors_get_label_const(name, feature);
+		if (!sf || sensors_get_value(name, sf->number, &value) ||
+		    value != (feature->number ? 3.3 : 1.5) ||
+		    !label || strcmp(label, feature->name)) {
+			fprintf(stderr, "hwmon0: %s reads wrong\n",
+				feature->name);
+			err = 1;
+		}
+	}
+	if (count != 2) {
+		fprintf(stderr, "hwmon0: %d features instead of 2\n", count);
+		err = 1;
+	}
+	/* Features of the previous device lead nowhere */
+	if (sensors_get_subfeature(name, old, SENSORS_SUBFEATURE_TEMP_INPUT)) {
+		fprintf(stderr, "hwmon0: previous features still found\n");
+		err = 1;
+	}
+
+	/* Back to what the other tests expect */
+	fakesys_delete_device(0);
+	err |= fakesys_inject("remove", 0, "hwmon") != 1;
+	create_device(0);
+	err |= fakesys_inject("add", 0, "hwmon") != 1;
+	return err;
+}
+
+static int run_tests(void)
+{
+	const sensors_chip_name *first, *name;
+	char bad[] = "add@/devices/virtual/hwmon/hwmon1\0ACTION=add";
+	double value;
+	int i, nr, err = 0;
+
+	/* Chips come one by one */
+	for (i = 0; i < DEVICES; i++) {
+		create_device(i);
+		if (fakesys_inject("add", i, "hwmon") != 1) {
+			fprintf(stderr, "hwmon%d: not added\n", i);
+			return 1;
+		}
+	}
+	nr = 0;
+	first = sensors_get_detected_chips(NULL, &nr);
+	err |= count_chips() != DEVICES;
+
+	/* Duplicate and unrelated events change nothing */
+	err |= fakesys_inject("add", 0, "hwmon") != 0;
+	err |= fakesys_inject("change", 1, "hwmon") != 0;
+	err |= fakesys_inject("remove", 2, "input") != 0;
+	err |= sensors_hotplug_apply(bad, sizeof(bad) - 1) != 0;
+	err |= sensors_hotplug_apply("", 0) != 0;
+	err |= count_chips() != DEVICES;
+	if (err) {
+		fprintf(stderr, "Unexpected changes\n");
+		return 1;
+	}
+
+	/* Every other chip goes */
+	for (i = 0; i < DEVICES; i += 2) {
+		fakesys_delete_device(i);
+		if (fakesys_inject("remove", i, "hwmon") != 1) {
+			fprintf(stderr, "hwmon%d: not removed\n", i);
+			return 1;
+		}
+	}
+	if (count_chips() != DEVICES / 2) {
+		fprintf(stderr, "Removed chips still listed\n");
+		return 1;
+	}
+	/* The name of a removed chip is still valid, but leads nowhere */
+	if (strcmp(first->prefix, "hp0") ||
+	    sensors_get_value(first, 0, &value) != -SENSORS_ERR_NO_ENTRY) {
+		fprintf(stderr, "Removed chip still found\n");
+		return 1;
+	}
+
+	/* And comes back */
+	create_device(0);
+	err |= fakesys_inject("add", 0, "hwmon") != 1;
+	err |= count_chips() != DEVICES / 2 + 1;
+	err |= check_chip(first, 0);
+
+	/* A chip which keeps coming back doesn't make the list grow */
+	for (i = 0; i < 10; i++) {
+		fakesys_delete_device(0);
+		err |= fakesys_inject("remove", 0, "hwmon") != 1;
+		create_device(0);
+		err |= fakesys_inject("add", 0, "hwmon") != 1;
+	}
+	if (err || sensors_proc_chips_count != DEVICES) {
+		fprintf(stderr, "Chip list grows as a chip comes and goes\n");
+		err = 1;
+	}
+
+	err |= check_replaced(first);
+	err |= check_chip(first, 0);
+
+	/* Chip names returned before the changes still work */
+	nr = 0;
+	while ((name = sensors_get_detected_chips(NULL, &nr)))
+		err |= check_chip(name, atoi(name->prefix + 2));
+
+	return err;
+}
+
+/* Changes whose events were lost are found by scanning again */
+static int run_rescan_tests(void)
+{
+	sensors_context *ctx;
+	int err = 0;
+
+	if (sensors_hotplug_open() < 0) {
+		fprintf(stderr, "No uevent socket, rescan not tested\n");
+		return 0;
+	}
+
+	/* Readers holding the published context don't see it change */
+	ctx = sensors_context_acquire();
+	lose_events = 1;
+	if (sensors_hotplug_process() != -SENSORS_ERR_BUSY || !lose_events) {
+		fprintf(stderr, "Context changed under a reference\n");
+		err = 1;
+	}
+	lose_events = 0;
+	sensors_context_release(ctx);
+
+	/* Nothing lost, nothing changes */
+	fakesys_delete_device(1);
+	fakesys_delete_device(3);
+	create_device(2);
+	if (sensors_hotplug_process() != 0) {
+		fprintf(stderr, "Changes found without events\n");
+		err = 1;
+	}
+
+	lose_events = 1;
+	if (sensors_hotplug_process() != 3 ||
+	    count_chips() != DEVICES / 2) {
+		fprintf(stderr, "Lost events not recovered\n");
+		err = 1;
+	}
+	if (sensors_proc_chips_count != DEVICES) {
+		fprintf(stderr, "Chip list grows on rescan\n");
+		err = 1;
+	}
+
+	sensors_hotplug_close();
+	return err;
+}
+
+int main(void)
+{
+	int err;
+
+	fakesys_setup("test-hotplug");
+
+	err = run_tests();
+	if (!err)
+		err = run_rescan_tests();
+	printf("%s\n", err ? "FAILED" : "OK");
+
+	sensors_cleanup();
+	fakesys_teardown();
+
+	return err;
+}
@@ -0,0 +1,264 @@
+/*
+    test-sampler.c - Check that samplers keep the values read on schedule,
+                     and that they can be read while being written.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * No hardware is needed: hwmon devices are created in a directory which
+ * stands for sysfs, see fakesys.c. The temperatures only ever go up,
+ * one digit at a time, so that they can be changed in place without being
+ * read half-written, and samples must never go down.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../sensors.h"
+#include "../data.h"
+#include "../error.h"
+#include "fakesys.h"
+
+#define DEVICES		2
+#define DEPTH		16
+#define READERS		4
+#define STEPS		9	/* Temperatures go from 1 to 9 degrees C */
+#define STEP_TIME	30	/* ms */
+
+static int value_fd[DEVICES];
+
+struct thread_data {
+	const sensors_sampler *sampler;
+	int err;
+	int rounds;
+};
+
+static int stop_readers;
+
+/* Create hwmon<nr>, a virtual device named hp<nr> with temp1_input at 1
+   degree C, and add it to the published context */
+static void add_device(int nr)
+{
+	char path[PATH_MAX + 16];
+
+	fakesys_create_device(nr);
+	fakesys_write_attr(nr, "temp1_input", "1000\n");
+	fakesys_device_path(path, nr);
+	strcat(path, "/temp1_input");
+	value_fd[nr] = open(path, O_WRONLY);
+	if (value_fd[nr] < 0) {
+		perror(path);
+		exit(1);
+	}
+	fakesys_announce(nr);
+}
+
+static long long ts_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+/* Returns 1 if the samples go back in time or down in value */
+static int check_samples(const sensors_sample *samples, int n)
+{
+	int i;
+
+	for (i = 1; i < n; i++)
+		if (ts_to_ns(&samples[i].time) <=
+		    ts_to_ns(&samples[i - 1].time) ||
+		    samples[i].value < samples[i - 1].value)
+			return 1;
+	return 0;
+}
+
+static void *read_sampler(void *arg)
+{
+	struct thread_data *data = arg;
+	sensors_sample samples[DEPTH];
+	double min, max, mean;
+	int i, n;
+
+	while (!__atomic_load_n(&stop_readers, __ATOMIC_ACQUIRE) &&
+	       !data->err) {
+		for (i = 0; i < DEVICES; i++) {
+			n = sensors_sampler_history(data->sampler, i, samples,
+						    DEPTH);
+			if (n < 0 || check_samples(samples, n)) {
+				fprintf(stderr, "Bad samples\n");
+				data->err = 1;
+			}
+			n = sensors_sampler_stats(data->sampler, i, DEPTH,
+						  &min, &max, &mean);
+			if (n < 0 || (n && (min > mean || mean > max ||
+					    min < 1 || max > STEPS))) {
+				fprintf(stderr, "Bad statistics\n");
+				data->err = 1;
+			}
+		}
+		data->rounds++;
+	}
+	return NULL;
+}
+
+static int run_tests(void)
+{
+	sensors_sampler_entry entries[DEVICES];
+	struct thread_data data[READERS];
+	pthread_t tids[READERS];
+	sensors_sampler *sampler;
+	sensors_sample samples[DEPTH];
+	sensors_stream *stream;
+	sensors_stream_cursor cursor;
+	sensors_stream_record record;
+	int counts[DEVICES] = { 0 };
+	double min, max, mean;
+	char buf[8];
+	int i, step, n, nr = 0, err = 0;
+
+	for (i = 0; i < DEVICES; i++)
+		add_device(i);
+
+	/* The first device is sampled 4 times as often as the second */
+	for (i = 0; i < DEVICES; i++) {
+		entries[i].name = sensors_get_detected_chips(NULL, &nr);
+		entries[i].subfeat_nr = 0;
+		entries[i].period = i ? 20 : 5;
+	}
+
+	/* Unknown subfeatures are refused */
+	entries[1].subfeat_nr = 1;
+	if (sensors_sampler_create(&sampler, entries, DEVICES, DEPTH) !=
+	    -SENSORS_ERR_NO_ENTRY) {
+		fprintf(stderr, "Unknown subfeature accepted\n");
+		return 1;
+	}
+	entries[1].subfeat_nr = 0;
+	if (sensors_sampler_create(&sampler, entries, -1, DEPTH) !=
+	    -SENSORS_ERR_NO_ENTRY) {
+		fprintf(stderr, "Negative count accepted\n");
+		return 1;
+	}
+
+	if (sensors_sampler_create(&sampler, entries, DEVICES, DEPTH)) {
+		fprintf(stderr, "Can't create sampler\n");
+		return 1;
+	}
+	stream = sensors_stream_new(256);
+	sensors_stream_cursor_init(stream, &cursor);
+	sensors_sampler_set_stream(sampler, stream);
+
+	for (i = 0; i < READERS; i++) {
+		data[i].sampler = sampler;
+		data[i].err = data[i].rounds = 0;
+		if (pthread_create(&tids[i], NULL, read_sampler, &data[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	for (step = 2; step <= STEPS; step++) {
+		usleep(STEP_TIME * 1000);
+		snprintf(buf, sizeof(buf), "%d", step);
+		for (i = 0; i < DEVICES; i++)
+			if (pwrite(value_fd[i], buf, 1, 0) != 1) {
+				perror("pwrite");
+				exit(1);
+			}
+	}
+	usleep(STEP_TIME * 1000);
+
+	__atomic_store_n(&stop_readers, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < READERS; i++) {
+		pthread_join(tids[i], NULL);
+		if (!data[i].rounds)
+			err = 1;
+		err |= data[i].err;
+	}
+
+	/* The ring of the first device wrapped around, that of the second
+	   may not have */
+	n = sensors_sampler_history(sampler, 0, samples, DEPTH);
+	if (n != DEPTH || check_samples(samples, n) ||
+	    samples[n - 1].value != STEPS) {
+		fprintf(stderr, "Wrong history\n");
+		err = 1;
+	}
+	if (sensors_sampler_history(sampler, 1, samples, 1) != 1 ||
+	    samples[0].value != STEPS) {
+		fprintf(stderr, "Wrong latest value\n");
+		err = 1;
+	}
+	n = sensors_sampler_stats(sampler, 0, 2, &min, &max, &mean);
+	if (n != 2 || min != STEPS || max != STEPS || mean != STEPS) {
+		fprintf(stderr, "Wrong statistics\n");
+		err = 1;
+	}
+	if (sensors_sampler_history(sampler, DEVICES, samples, 1) !=
+	    -SENSORS_ERR_NO_ENTRY) {
+		fprintf(stderr, "Unknown entry accepted\n");
+		err = 1;
+	}
+	if (sensors_sampler_history(sampler, 0, samples, -1) !=
+	    -SENSORS_ERR_NO_ENTRY ||
+	    sensors_sampler_stats(sampler, 0, -1, &min, &max, &mean) !=
+	    -SENSORS_ERR_NO_ENTRY) {
+		fprintf(stderr, "Negative count accepted\n");
+		err = 1;
+	}
+
+	sensors_sampler_free(sampler);
+
+	/* The stream got the samples of both devices, more of the first */
+	while (sensors_stream_read(stream, &cursor, &record, 1) == 1) {
+		if (record.chip < 0 || record.chip >= DEVICES ||
+		    record.subfeat_nr != 0 || record.value < 1 ||
+		    record.value > STEPS) {
+			fprintf(stderr, "Bad stream record\n");
+			err = 1;
+			break;
+		}
+		counts[record.chip]++;
+	}
+	if (cursor.lost || counts[0] <= counts[1] || !counts[1]) {
+		fprintf(stderr, "Wrong stream records\n");
+		err = 1;
+	}
+	sensors_stream_free(stream);
+
+	return err;
+}
+
+int main(void)
+{
+	int i, err;
+
+	fakesys_setup("test-sampler");
+
+	err = run_tests();
+	printf("%s\n", err ? "FAILED" : "OK");
+
+	sensors_cleanup();
+	for (i = 0; i < DEVICES; i++)
+		close(value_fd[i]);
+	fakesys_teardown();
+
+	return err;
+}
@@ -0,0 +1,205 @@
+/*
+    test-stream.c - Check that consumers of a stream get every record in
+                    order, or know how many they missed, and never a torn
+                    record.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * The producer pushes records at 10 kHz for a second, then as fast as it
+ * can. Each field of record number nr is derived from nr, so a record
+ * mixing two writes is noticed. Half of the consumers read continuously,
+ * the other half sleep long enough for the ring to wrap around meanwhile.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../sensors.h"
+
+#define RING		256
+#define CONSUMERS	8
+#define PACED		10000	/* Records pushed at 10 kHz */
+#define BURST		200000	/* Records pushed without waiting */
+#define PERIOD		100000	/* ns */
+#define SLOW_SLEEP	50	/* ms */
+#define BATCH		32
+
+struct thread_data {
+	sensors_stream_cursor cursor;
+	int slow;
+	int err;
+	unsigned long long received;
+};
+
+static sensors_stream *stream;
+static int done;
+
+static long long ts_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void *produce(void *arg)
+{
+	sensors_stream_record record;
+	struct timespec next;
+	int nr;
+
+	(void)arg;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (nr = 0; nr < PACED + BURST; nr++) {
+		if (nr < PACED) {
+			next.tv_nsec += PERIOD;
+			if (next.tv_nsec >= 1000000000L) {
+				next.tv_sec++;
+				next.tv_nsec -= 1000000000L;
+			}
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &next, NULL))
+				;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &record.time);
+		record.chip = nr % 977;
+		record.subfeat_nr = nr;
+		record.value = nr * 3.0 + 1;
+		sensors_stream_push(stream, &record);
+	}
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void *consume(void *arg)
+{
+	struct thread_data *data = arg;
+	sensors_stream_record records[BATCH];
+	struct timespec ts;
+	unsigned long long expect = 0, skipped = 0, nr;
+	long long last = 0;
+	int i, n, finished;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = SLOW_SLEEP * 1000000L;
+
+	do {
+		/* Only stop once everything pushed before was read */
+		finished = __atomic_load_n(&done, __ATOMIC_ACQUIRE);
+		n = sensors_stream_read(stream, &data->cursor, records, BATCH);
+		for (i = 0; i < n; i++) {
+			nr = records[i].subfeat_nr;
+			if (nr < expect ||
+			    records[i].chip != (int)(nr % 977) ||
+			    records[i].value != nr * 3.0 + 1 ||
+			    ts_to_ns(&records[i].time) < last) {
+				fprintf(stderr, "Bad record %llu\n", nr);
+				data->err = 1;
+				return NULL;
+			}
+			skipped += nr - expect;
+			expect = nr + 1;
+			last = ts_to_ns(&records[i].time);
+		}
+		data->received += n;
+		if (expect != data->cursor.next ||
+		    skipped != data->cursor.lost) {
+			fprintf(stderr, "Lost records not accounted for\n");
+			data->err = 1;
+			return NULL;
+		}
+
+		if (data->slow)
+			nanosleep(&ts, NULL);
+	} while (n || !finished);
+
+	return NULL;
+}
+
+static int run_tests(void)
+{
+	struct thread_data data[CONSUMERS];
+	pthread_t producer, tids[CONSUMERS];
+	sensors_stream_record record;
+	int i, slow_lost = 0, err = 0;
+
+	stream = sensors_stream_new(RING - 1);
+
+	/* Nothing to read yet */
+	sensors_stream_cursor_init(stream, &data[0].cursor);
+	if (sensors_stream_read(stream, &data[0].cursor, &record, 1) != 0) {
+		fprintf(stderr, "Record read from an empty stream\n");
+		err = 1;
+	}
+
+	/* All consumers start with the first record */
+	for (i = 0; i < CONSUMERS; i++) {
+		sensors_stream_cursor_init(stream, &data[i].cursor);
+		data[i].slow = i % 2;
+		data[i].err = 0;
+		data[i].received = 0;
+		if (pthread_create(&tids[i], NULL, consume, &data[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	if (pthread_create(&producer, NULL, produce, NULL)) {
+		perror("pthread_create");
+		exit(1);
+	}
+
+	pthread_join(producer, NULL);
+	for (i = 0; i < CONSUMERS; i++) {
+		pthread_join(tids[i], NULL);
+		err |= data[i].err;
+		if (data[i].received + data[i].cursor.lost != PACED + BURST) {
+			fprintf(stderr, "Consumer %d: %llu records read, %llu "
+				"lost, %d pushed\n", i, data[i].received,
+				data[i].cursor.lost, PACED + BURST);
+			err = 1;
+		}
+		if (data[i].slow && data[i].cursor.lost)
+			slow_lost = 1;
+	}
+
+	/* The ring is rounded up to a power of 2, and slow consumers can't
+	   keep up with it */
+	if (!slow_lost) {
+		fprintf(stderr, "Slow consumers didn't lose records\n");
+		err = 1;
+	}
+
+	/* A consumer which starts late only gets the next records */
+	sensors_stream_cursor_init(stream, &data[0].cursor);
+	if (sensors_stream_read(stream, &data[0].cursor, &record, 1) != 0 ||
+	    data[0].cursor.lost) {
+		fprintf(stderr, "Old record read by a new consumer\n");
+		err = 1;
+	}
+
+	sensors_stream_free(stream);
+	return err;
+}
+
+int main(void)
+{
+	int err;
+
+	err = run_tests();
+	printf("%s\n", err ? "FAILED" : "OK");
+
+	return err;
+}
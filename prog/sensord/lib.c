@@ -22,6 +22,7 @@
  */
 
 #include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,76 +31,134 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
+#include "args.h"
 #include "sensord.h"
 #include "lib/error.h"
 
-static int loadConfig(const char *cfgPath, int reload)
+static int alarmFd = -1;
+
+/* Get notified of alarm changes, so that they are logged without waiting
+   for the next scan */
+static void openAlarms(void)
+{
+	sensors_alarm_close();
+	alarmFd = -1;
+	if (!sensord_args.scanTime)
+		return;
+
+	/* Drivers which don't notify are left to scanChips() */
+	alarmFd = sensors_alarm_open(0);
+	if (alarmFd < 0) {
+		sensorLog(LOG_NOTICE, "Alarm notifications not available: %s",
+			  sensors_strerror(alarmFd));
+		alarmFd = -1;
+	}
+}
+
+/* Load the configuration and detect the chips into a new context, so that
+   the current one remains usable until it is ready, and if that fails.
+   Returns NULL on error. */
+static sensors_context *loadConfig(const char *cfgPath)
 {
+	sensors_context *ctx;
+	FILE *fp = NULL;
 	int ret;
- 	FILE *fp;
 
- 	/* Load default configuration. */
- 	if (!cfgPath) {
- 		if (reload) {
-			sensorLog(LOG_INFO, "configuration reloading");
-			sensors_cleanup();
+	if (cfgPath) {
+		fp = fopen(cfgPath, "r");
+		if (!fp) {
+			sensorLog(LOG_ERR, "Error opening config file %s: %s",
+				  cfgPath, strerror(errno));
+			return NULL;
 		}
+	}
 
- 		ret = sensors_init(NULL);
- 		if (ret) {
- 			sensorLog(LOG_ERR, "Error loading default"
- 				  " configuration file: %s",
- 				  sensors_strerror(ret));
- 			return -1;
-  		}
- 		return 0;
- 	}
-
- 	fp = fopen(cfgPath, "r");
- 	if (!fp) {
- 		sensorLog(LOG_ERR, "Error opening config file %s: %s",
- 			  strerror(errno));
- 		return -1;
- 	}
-
-	if (reload) {
-		sensorLog(LOG_INFO, "configuration reloading");
-		sensors_cleanup();
+	/* Use the default configuration file if none was given */
+	ctx = sensors_context_new();
+	ret = sensors_init_filtered_ctx(ctx, fp, sensord_args.chipNames,
+					sensord_args.numChipNames);
+	if (fp)
+		fclose(fp);
+	if (ret) {
+		if (cfgPath)
+			sensorLog(LOG_ERR, "Error loading sensors configuration"
+				  " file %s: %s", cfgPath,
+				  sensors_strerror(ret));
+		else
+			sensorLog(LOG_ERR, "Error loading default"
+				  " configuration file: %s",
+				  sensors_strerror(ret));
+		sensors_context_free(ctx);
+		return NULL;
 	}
- 	ret = sensors_init(fp);
- 	if (ret) {
- 		sensorLog(LOG_ERR, "Error loading sensors configuration file"
-			  " %s: %s", cfgPath, sensors_strerror(ret));
- 		fclose(fp);
- 		return -1;
- 	}
- 	fclose(fp);
-
- 	return 0;
+
+	return ctx;
 }
 
 int loadLib(const char *cfgPath)
 {
-	int ret;
-	ret = loadConfig(cfgPath, 0);
-	if (!ret)
-		ret = initKnownChips();
-	return ret;
+	sensors_context *ctx;
+
+	/* We read the same attributes over and over again */
+	sensors_set_option(SENSORS_OPT_CACHE_FDS, 1);
+
+	ctx = loadConfig(cfgPath);
+	if (!ctx)
+		return -1;
+	sensors_context_publish(ctx);
+	openAlarms();
+	return initKnownChips();
 }
 
 int reloadLib(const char *cfgPath)
 {
-	int ret;
+	sensors_context *ctx;
+
+	sensorLog(LOG_INFO, "configuration reloading");
+	ctx = loadConfig(cfgPath);
+	if (!ctx)
+		return -1;
+
+	/* The chip names of knownChips belong to the old context, which
+	   goes away when the new one is published */
 	freeKnownChips();
-	ret = loadConfig(cfgPath, 1);
-	if (!ret)
-		ret = initKnownChips();
-	return ret;
+	sensors_context_publish(ctx);
+	openAlarms();
+	return initKnownChips();
 }
 
 int unloadLib(void)
 {
+	sensors_alarm_close();
 	freeKnownChips();
 	sensors_cleanup();
 	return 0;
 }
+
+int waitAlarms(int *sleepTime)
+{
+	sensors_alarm_event events[16];
+	struct pollfd pfd;
+	time_t start;
+	int n, changed = 0;
+
+	if (alarmFd < 0) {
+		sleep(*sleepTime);
+		return 0;
+	}
+
+	start = time(NULL);
+	pfd.fd = alarmFd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, *sleepTime * 1000) == 0)
+		return 0;
+
+	do {
+		n = sensors_alarm_drain(events, ARRAY_SIZE(events));
+		if (n > 0)
+			changed = 1;
+	} while (n == ARRAY_SIZE(events));
+
+	*sleepTime = time(NULL) - start;
+	return changed;
+}
@@ -78,7 +78,7 @@ static void signalHandler(int sig)
 static int sensord(void)
 {
 	int ret = 0;
-	int scanValue = 0, logValue = 0;
+	int scanValue = 0, logValue = 0, alarmed = 0;
 	/*
 	 * First RRD update at next RRD timeslot to prevent failures due
 	 * one timeslot updated twice on restart for example.
@@ -96,11 +96,14 @@ static int sensord(void)
 					  " error");
 			reload = 0;
 		}
-		if (sensord_args.scanTime && (scanValue <= 0)) {
+		if (sensord_args.scanTime && (scanValue <= 0 || alarmed)) {
 			if ((ret = scanChips()))
 				sensorLog(LOG_NOTICE,
 					  "sensor scan error (%d)", ret);
-			scanValue += sensord_args.scanTime;
+			/* Scans on alarm changes come in addition */
+			if (scanValue <= 0)
+				scanValue += sensord_args.scanTime;
+			alarmed = 0;
 		}
 		if (sensord_args.logTime && (logValue <= 0)) {
 			if ((ret = readChips()))
@@ -128,7 +131,7 @@ static int sensord(void)
 				? rrdValue : INT_MAX;
 			int sleepTime = (a < b) ? ((a < c) ? a : c) :
 				((b < c) ? b : c);
-			sleep(sleepTime);
+			alarmed = waitAlarms(&sleepTime);
 			scanValue -= sleepTime;
 			logValue -= sleepTime;
 			rrdValue -= sleepTime;
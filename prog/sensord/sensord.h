@@ -38,6 +38,9 @@ extern void freeChips(void);
 extern int loadLib(const char *cfgPath);
 extern int reloadLib(const char *cfgPath);
 extern int unloadLib(void);
+/* Sleep for up to *sleepTime seconds, less if an alarm changed. Returns 1
+   if one did, and stores the number of seconds slept in *sleepTime. */
+extern int waitAlarms(int *sleepTime);
 
 /* from sense.c */
 
@@ -83,8 +83,11 @@ static void print_version(void)
 	       libsensors_version);
 }
 
-/* Return 0 on success, and an exit error code otherwise */
-static int read_config_file(const char *config_file_name)
+/* Return 0 on success, and an exit error code otherwise. Only the chips
+   matching one of the count names of match are detected, all if match is
+   NULL. */
+static int read_config_file(const char *config_file_name,
+			    const sensors_chip_name *match, int count)
 {
 	FILE *config_file;
 	int err;
@@ -105,7 +108,7 @@ static int read_config_file(const char *config_file_name)
 		config_file = NULL;
 	}
 
-	err = sensors_init(config_file);
+	err = sensors_init_filtered(config_file, match, count);
 	if (err) {
 		fprintf(stderr, "sensors_init: %s\n", sensors_strerror(err));
 		if (config_file)
@@ -271,8 +274,9 @@ static void print_bus_list(void)
 
 int main(int argc, char *argv[])
 {
-	int c, i, err, do_bus_list, allow_no_sensors;
+	int c, i, err, do_bus_list, allow_no_sensors, chip_count = 0;
 	const char *config_file_name = NULL;
+	sensors_chip_name *chips = NULL;
 
 	struct option long_opts[] =  {
 		{ "help", no_argument, NULL, 'h' },
@@ -340,9 +344,31 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	err = read_config_file(config_file_name);
+	/* Parse the chip names first, so that only these chips are
+	   detected */
+	if (!do_bus_list && optind < argc) {
+		chips = malloc((argc - optind) * sizeof(sensors_chip_name));
+		if (!chips) {
+			perror("malloc");
+			exit(1);
+		}
+		for (i = optind; i < argc; i++) {
+			if (sensors_parse_chip_name(argv[i],
+						    &chips[chip_count])) {
+				fprintf(stderr,
+					"Parse error in chip name `%s'\n",
+					argv[i]);
+				print_short_help();
+				err = 1;
+				goto exit_free;
+			}
+			chip_count++;
+		}
+	}
+
+	err = read_config_file(config_file_name, chips, chip_count);
 	if (err)
-		exit(err);
+		goto exit_free;
 
 	/* build the degrees string */
 	set_degstr();
@@ -361,20 +387,9 @@ int main(int argc, char *argv[])
 		}
 	} else {
 		int cnt = 0;
-		sensors_chip_name chip;
 
-		for (i = optind; i < argc; i++) {
-			if (sensors_parse_chip_name(argv[i], &chip)) {
-				fprintf(stderr,
-					"Parse error in chip name `%s'\n",
-					argv[i]);
-				print_short_help();
-				err = 1;
-				goto exit;
-			}
-			cnt += do_the_real_work(&chip, &err);
-			sensors_free_chip_name(&chip);
-		}
+		for (i = 0; i < chip_count; i++)
+			cnt += do_the_real_work(&chips[i], &err);
 
 		if (!cnt) {
 			fprintf(stderr, "Specified sensor(s) not found!\n");
@@ -382,7 +397,10 @@ int main(int argc, char *argv[])
 		}
 	}
 
-exit:
 	sensors_cleanup();
+exit_free:
+	for (i = 0; i < chip_count; i++)
+		sensors_free_chip_name(&chips[i]);
+	free(chips);
 	exit(err);
 }